@@ -0,0 +1,311 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/array_list.h"
+#include "../src/common.h"
+#include "../src/dyn_string.h"
+#include "../src/executor.h"
+#include "../src/parser.h"
+#include "../src/vars.h"
+
+/// A sample is at least this long, so that the clock's resolution doesn't matter
+#define MIN_SAMPLE_NS 50000000ull
+#define SAMPLES 5
+
+#define VARS_COUNT 10000
+#define LIST_APPENDS 100000
+#define SCRIPT_LINES 100000
+#define CAPTURED_BYTES (8u << 20)
+
+typedef struct {
+    const char* name;
+    /// runs the measured code once, which does `ops` operations
+    void (*run)(void);
+    size_t ops;
+    /// data processed by one run, `0` if throughput makes no sense for the benchmark
+    size_t bytes;
+} Benchmark;
+
+static char* blush_path;
+static char script_path[] = "/tmp/blush-bench-script-XXXXXX";
+static char data_path[] = "/tmp/blush-bench-data-XXXXXX";
+
+static unsigned long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+/// Keeps the compiler from dropping computations whose results are otherwise unused
+static volatile size_t sink;
+
+static String parse_source;
+static Arena parse_arena;
+
+/// The tokenizer is internal to the parser, it is measured through `Program_parse` on words
+/// with quotes, variables and operators, where tokenizing is most of the work
+static void setupParse(void) {
+    static const char line[] =
+        "echo \"hello $USER\" 'single quoted' plain-word --flag=value $HOME/dir | grep -v x "
+        "> /dev/null\n"
+        "export NAME=value OTHER=\"a b c\"\n"
+        "cd /tmp/some/long/path/name\n";
+    String_init(&parse_source);
+    for (size_t i = 0; i < 1000; ++i) {
+        String_appendSlice(&parse_source, line, sizeof(line) - 1);
+    }
+    Arena_init(&parse_arena);
+}
+
+static void runParse(void) {
+    Program program;
+    ParseError error;
+    ParseResult res =
+        Program_parse(&program, &parse_arena, parse_source.items, parse_source.size, &error);
+    assert(res == ParseResult_Success);
+    UNUSED(res);
+    sink += program.pipelines.size;
+    Arena_reset(&parse_arena);
+}
+
+static Vars vars;
+static char var_names[VARS_COUNT][16];
+
+static void setupVars(void) {
+    Vars_init(&vars);
+    for (size_t i = 0; i < VARS_COUNT; ++i) {
+        const int len = snprintf(var_names[i], sizeof(var_names[i]), "BENCH_VAR_%zu", i);
+        Vars_set(&vars, var_names[i], (size_t)len, "value", strlen("value"), true);
+    }
+}
+
+static void runVarsGet(void) {
+    for (size_t i = 0; i < VARS_COUNT; ++i) {
+        sink += (size_t)Vars_get(&vars, var_names[i], strlen(var_names[i]));
+    }
+}
+
+static void runVarsSet(void) {
+    for (size_t i = 0; i < VARS_COUNT; ++i) {
+        Vars_set(&vars, var_names[i], strlen(var_names[i]), "other", strlen("other"), true);
+    }
+}
+
+ARRAY_LIST_STRUCT(size_t, Numbers)
+ARRAY_LIST_SIGNATURES(size_t, Numbers)
+ARRAY_LIST_IMPL(size_t, Numbers)
+
+static void runListGrowth(void) {
+    Numbers numbers;
+    Numbers_init(&numbers);
+    for (size_t i = 0; i < LIST_APPENDS; ++i) {
+        Numbers_append(&numbers, i);
+    }
+    sink += numbers.items[LIST_APPENDS - 1];
+    Numbers_deinit(&numbers);
+}
+
+/// Runs the shell binary with `args` and waits for it, its output is discarded
+static void runShell(char** args) {
+    const pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        const int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1) {
+            dup2(null_fd, STDOUT_FILENO);
+        }
+        execv(blush_path, args);
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s exited with status %d\n", blush_path, status);
+        exit(1);
+    }
+}
+
+static void runStartup(void) {
+    static char dash_c[] = "-c";
+    static char empty[] = "";
+    char* args[] = {blush_path, dash_c, empty, NULL};
+    runShell(args);
+}
+
+static void setupScript(void) {
+    const int fd = mkstemp(script_path);
+    if (fd == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    FILE* f = fdopen(fd, "w");
+    for (size_t i = 0; i < SCRIPT_LINES; ++i) {
+        fprintf(f, "x=%zu\n", i);
+    }
+    fclose(f);
+}
+
+static void runScript(void) {
+    char* args[] = {blush_path, script_path, NULL};
+    runShell(args);
+}
+
+static Executor executor;
+static String true_cmd;
+
+/// `true` is a builtin, so the executable is run by its path
+static void setupForkExec(void) {
+    const char* path =
+        PathCache_lookup(&executor.path_cache, Executor_getVarCStr(&executor, "PATH"), "true");
+    if (path == NULL) {
+        fprintf(stderr, "No `true` executable in PATH\n");
+        exit(1);
+    }
+    String_init(&true_cmd);
+    String_appendSlice(&true_cmd, path, strlen(path));
+    String_append(&true_cmd, '\n');
+}
+
+static void runForkExec(void) {
+    ExecutionResult res = Executor_execute(&executor, true_cmd.items, true_cmd.size);
+    assert(res == ExecutionResult_Success);
+    UNUSED(res);
+}
+
+static String capture_cmd;
+
+static void setupCapture(void) {
+    const int fd = mkstemp(data_path);
+    if (fd == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    FILE* f = fdopen(fd, "w");
+    for (size_t i = 0; i < CAPTURED_BYTES / 64; ++i) {
+        fprintf(f, "%063zu\n", i);
+    }
+    fclose(f);
+
+    String_init(&capture_cmd);
+    String_appendSlice(&capture_cmd, "x=$(cat ", strlen("x=$(cat "));
+    String_appendSlice(&capture_cmd, data_path, strlen(data_path));
+    String_appendSlice(&capture_cmd, ")\n", strlen(")\n"));
+}
+
+/// The output of a command substitution goes through the pipe `Executor_forkExec` sets up and is
+/// read by the shell itself
+static void runCapture(void) {
+    ExecutionResult res = Executor_execute(&executor, capture_cmd.items, capture_cmd.size);
+    assert(res == ExecutionResult_Success);
+    UNUSED(res);
+}
+
+static const Benchmark benchmarks[] = {
+    {"parse", runParse, 3000, 0},
+    {"vars_get", runVarsGet, VARS_COUNT, 0},
+    {"vars_set", runVarsSet, VARS_COUNT, 0},
+    {"array_list_append", runListGrowth, LIST_APPENDS, 0},
+    {"startup", runStartup, 1, 0},
+    {"script_line", runScript, SCRIPT_LINES, 0},
+    {"fork_exec_true", runForkExec, 1, 0},
+    {"capture_output", runCapture, 1, CAPTURED_BYTES},
+};
+
+static int compareNs(const void* lhs, const void* rhs) {
+    const double a = *(const double*)lhs;
+    const double b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+/// Doubles the runs per sample until a sample is long enough, then takes `SAMPLES` of them
+static void measure(const Benchmark* bench, bool first) {
+    size_t runs = 1;
+    unsigned long long elapsed;
+    for (;;) {
+        const unsigned long long start = nowNs();
+        for (size_t i = 0; i < runs; ++i) {
+            bench->run();
+        }
+        elapsed = nowNs() - start;
+        if (elapsed >= MIN_SAMPLE_NS) {
+            break;
+        }
+        runs *= 2;
+    }
+
+    double samples[SAMPLES];
+    samples[0] = (double)elapsed;
+    for (size_t i = 1; i < SAMPLES; ++i) {
+        const unsigned long long start = nowNs();
+        for (size_t j = 0; j < runs; ++j) {
+            bench->run();
+        }
+        samples[i] = (double)(nowNs() - start);
+    }
+    const double ops = (double)runs * (double)bench->ops;
+    for (size_t i = 0; i < SAMPLES; ++i) {
+        samples[i] /= ops;
+    }
+    qsort(samples, SAMPLES, sizeof(double), compareNs);
+
+    printf("%s\n    {\"name\": \"%s\", \"ops\": %.0f, \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f",
+           first ? "" : ",", bench->name, ops * SAMPLES, samples[SAMPLES / 2], samples[0]);
+    if (bench->bytes > 0) {
+        const double bytes_per_op = (double)bench->bytes / (double)bench->ops;
+        printf(", \"bytes_per_sec\": %.0f", bytes_per_op * 1e9 / samples[SAMPLES / 2]);
+    }
+    printf("}");
+    fflush(stdout);
+}
+
+/// Usage: `bench BLUSH_PATH [NAME...]`, only the benchmarks named are run if any are. Prints the
+/// results as JSON, times are the median and the fastest of the samples
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s BLUSH_PATH [NAME...]\n", argv[0]);
+        return 2;
+    }
+    blush_path = argv[1];
+
+    setupParse();
+    setupVars();
+    setupScript();
+    setupCapture();
+    Executor_init(&executor);
+    setupForkExec();
+
+    printf("{\"benchmarks\": [");
+    bool first = true;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+        bool selected = argc == 2;
+        for (int j = 2; j < argc; ++j) {
+            selected = selected || strcmp(argv[j], benchmarks[i].name) == 0;
+        }
+        if (selected) {
+            measure(&benchmarks[i], first);
+            first = false;
+        }
+    }
+    printf("\n]}\n");
+
+    Executor_deinit(&executor);
+    String_deinit(&true_cmd);
+    unlink(script_path);
+    unlink(data_path);
+    String_deinit(&capture_cmd);
+    String_deinit(&parse_source);
+    Arena_deinit(&parse_arena);
+    Vars_deinit(&vars);
+    return 0;
+}
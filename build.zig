@@ -24,13 +24,21 @@ const lto_flags: []const []const u8 = &.{
     "-flto=full",
 };
 
+/// everything but `main`, shared by the shell and the benchmarks
 const files: []const []const u8 = &.{
-    "src/main.c",
     "src/executor.c",
+    "src/parser.c",
     "src/interactive.c",
     "src/dyn_string.c",
     "src/vars.c",
+    "src/reaper.c",
+    "src/path_cache.c",
     "src/alloc.c",
+    "src/jobs.c",
+    "src/builtins.c",
+    "src/history.c",
+    "src/completion.c",
+    "src/trace.c",
 };
 
 pub fn build(b: *std.Build) !void {
@@ -64,8 +72,40 @@ pub fn build(b: *std.Build) !void {
         .files = files,
         .flags = flags.items,
     });
+    exe.addCSourceFiles(.{
+        .files = &.{"src/main.c"},
+        .flags = flags.items,
+    });
+    exe.linkSystemLibrary("m");
     if (sanitize) {
         exe.linkSystemLibrary("asan");
     }
     b.installArtifact(exe);
+
+    const bench = b.addExecutable(.{
+        .name = "blush-bench",
+        .target = target,
+        .optimize = optimize,
+        .link_libc = true,
+    });
+    bench.addCSourceFiles(.{
+        .files = files,
+        .flags = flags.items,
+    });
+    bench.addCSourceFiles(.{
+        .files = &.{"bench/bench.c"},
+        .flags = flags.items,
+    });
+    bench.linkSystemLibrary("m");
+    if (sanitize) {
+        bench.linkSystemLibrary("asan");
+    }
+
+    const run_bench = b.addRunArtifact(bench);
+    run_bench.addArtifactArg(exe);
+    if (b.args) |args| {
+        run_bench.addArgs(args);
+    }
+    const bench_step = b.step("bench", "Run the benchmarks, results are printed as JSON");
+    bench_step.dependOn(&run_bench.step);
 }
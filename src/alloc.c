@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static void report(const size_t required_size) {
   fprintf(stderr, "Error: could not allocate %zu bytes of memory\n",
@@ -32,3 +33,101 @@ void* reallocChecked(void* ptr, const size_t size) {
   }
   return result;
 }
+
+#define ARENA_CHUNK_SIZE 16384
+#define ARENA_ALIGNMENT 16
+
+struct ArenaChunk {
+  ArenaChunk* next;
+  char* data;
+  size_t cap;
+  size_t used;
+};
+
+static size_t alignUp(const size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+void Arena_init(Arena* self) {
+  *self = (Arena){
+    .head = NULL,
+    .tail = NULL,
+    .cur = NULL,
+    .last = NULL,
+  };
+}
+
+void Arena_deinit(Arena* self) {
+  ArenaChunk* chunk = self->head;
+  while (chunk) {
+    ArenaChunk* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  Arena_init(self);
+}
+
+static ArenaChunk* Arena_addChunk(Arena* self, const size_t min_size) {
+  const size_t cap = (min_size > ARENA_CHUNK_SIZE) ? min_size : ARENA_CHUNK_SIZE;
+  const size_t header_size = alignUp(sizeof(ArenaChunk));
+  ArenaChunk* chunk = mallocChecked(header_size + cap);
+  *chunk = (ArenaChunk){
+    .next = NULL,
+    .data = (char*)chunk + header_size,
+    .cap = cap,
+    .used = 0,
+  };
+
+  if (self->tail) {
+    self->tail->next = chunk;
+  } else {
+    self->head = chunk;
+  }
+  self->tail = chunk;
+  return chunk;
+}
+
+void* Arena_alloc(Arena* self, size_t size) {
+  size = alignUp(size);
+  // chunks after `cur` are unused, the ones before it are considered full
+  while (self->cur && self->cur->cap - self->cur->used < size) {
+    self->cur = self->cur->next;
+  }
+  if (!self->cur) {
+    self->cur = Arena_addChunk(self, size);
+  }
+
+  void* result = self->cur->data + self->cur->used;
+  self->cur->used += size;
+  self->last = result;
+  return result;
+}
+
+void* Arena_realloc(Arena* self, void* ptr, const size_t old_size, const size_t new_size) {
+  if (!ptr) {
+    return Arena_alloc(self, new_size);
+  }
+
+  if (ptr == self->last) {
+    const size_t offset = (size_t)((char*)ptr - self->cur->data);
+    if (self->cur->cap - offset >= alignUp(new_size)) {
+      self->cur->used = offset + alignUp(new_size);
+      return ptr;
+    }
+  }
+  if (new_size <= old_size) {
+    return ptr;
+  }
+
+  void* result = Arena_alloc(self, new_size);
+  memcpy(result, ptr, old_size);
+  return result;
+}
+
+void Arena_reset(Arena* self) {
+  for (ArenaChunk* chunk = self->head; chunk; chunk = chunk->next) {
+    chunk->used = 0;
+  }
+  self->cur = self->head;
+  self->last = NULL;
+}
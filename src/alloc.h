@@ -5,3 +5,22 @@
 void* mallocChecked(size_t size);
 void* callocChecked(size_t n, size_t elem_size);
 void* reallocChecked(void* ptr, size_t size);
+
+typedef struct ArenaChunk ArenaChunk;
+
+/// Bump allocator for short-lived data. Nothing is freed individually, `Arena_reset` releases
+/// everything at once but keeps the chunks, so a warmed up arena does not call `malloc` at all
+typedef struct {
+    ArenaChunk* head;
+    ArenaChunk* tail;
+    ArenaChunk* cur;
+    void* last;
+} Arena;
+
+void Arena_init(Arena* self);
+void Arena_deinit(Arena* self);
+void* Arena_alloc(Arena* self, size_t size);
+
+/// Grows the most recent allocation in place when possible, otherwise copies `old_size` bytes
+void* Arena_realloc(Arena* self, void* ptr, size_t old_size, size_t new_size);
+void Arena_reset(Arena* self);
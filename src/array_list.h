@@ -13,45 +13,51 @@
         size_t cap;                \
     } NAME;
 
+/// Same as `ARRAY_LIST_STRUCT`, but the items are allocated from `arena` and are released
+/// together with everything else in it on `Arena_reset`
+#define ARENA_ARRAY_LIST_STRUCT(T, NAME) \
+    typedef struct NAME {                \
+        T* items;                        \
+        size_t size;                     \
+        size_t cap;                      \
+        Arena* arena;                    \
+    } NAME;
+
+#define ARRAY_LIST_COMMON_SIGNATURES_(T, NAME)                       \
+    void NAME##_swap(NAME* lhs, NAME* rhs);                          \
+    void NAME##_clear(NAME* arr);                                    \
+    T* NAME##_toOwnedSlice(NAME* arr);                               \
+    void NAME##_ensureCapacityExact(NAME* arr, size_t required_cap); \
+    void NAME##_ensureCapacity(NAME* arr, size_t required_cap);      \
+    void NAME##_resize(NAME* arr, size_t required_size);             \
+    void NAME##_append(NAME* arr, T elem);                           \
+    void NAME##_appendSlice(NAME* arr, const T* ptr, size_t len);    \
+    void NAME##_appendN(NAME* arr, size_t count, T filler);          \
+    void NAME##_insert(NAME* arr, T item, size_t index);             \
+    T NAME##_pop(NAME* arr);                                         \
+    T NAME##_remove(NAME* arr, size_t index);                        \
+    void NAME##_removeSlice(NAME* arr, size_t begin, size_t end);    \
+    void NAME##_moveElement(NAME* arr, size_t from, size_t to);
+
 #define ARRAY_LIST_SIGNATURES(T, NAME)                                 \
     void NAME##_init(NAME* arr);                                       \
     void NAME##_initWithCapacity(NAME* arr, size_t required_capacity); \
     void NAME##_initFromSlice(NAME* arr, const T* ptr, size_t len);    \
-    void NAME##_swap(NAME* lhs, NAME* rhs);                            \
     void NAME##_deinit(NAME* arr);                                     \
-    void NAME##_clear(NAME* arr);                                      \
-    T* NAME##_toOwnedSlice(NAME* arr);                                 \
-    void NAME##_ensureCapacityExact(NAME* arr, size_t required_cap);   \
-    void NAME##_ensureCapacity(NAME* arr, size_t required_cap);        \
-    void NAME##_resize(NAME* arr, size_t required_size);               \
-    void NAME##_append(NAME* arr, T elem);                             \
-    void NAME##_appendSlice(NAME* arr, const T* ptr, size_t len);      \
-    void NAME##_appendN(NAME* arr, size_t count, T filler);            \
-    void NAME##_insert(NAME* arr, T item, size_t index);               \
-    T NAME##_pop(NAME* arr);                                           \
-    T NAME##_remove(NAME* arr, size_t index);                          \
-    void NAME##_removeSlice(NAME* arr, size_t begin, size_t end);      \
-    void NAME##_moveElement(NAME* arr, size_t from, size_t to);
+    ARRAY_LIST_COMMON_SIGNATURES_(T, NAME)
 
-#define ARRAY_LIST_IMPL(T, NAME)                                                                  \
-    void NAME##_init(NAME* arr) {                                                                 \
-        assert(arr);                                                                              \
-        *arr = (NAME){                                                                            \
-            .items = NULL,                                                                        \
-            .cap = 0,                                                                             \
-            .size = 0,                                                                            \
-        };                                                                                        \
-    }                                                                                             \
-    void NAME##_initWithCapacity(NAME* arr, size_t required_capacity) {                           \
-        assert(arr);                                                                              \
-        NAME##_init(arr);                                                                         \
-        NAME##_ensureCapacity(arr, required_capacity);                                            \
-    }                                                                                             \
-    void NAME##_initFromSlice(NAME* arr, const T* ptr, size_t len) {                              \
-        assert(arr);                                                                              \
-        NAME##_initWithCapacity(arr, len);                                                        \
-        NAME##_appendSlice(arr, ptr, len);                                                        \
-    }                                                                                             \
+#define ARENA_ARRAY_LIST_SIGNATURES(T, NAME)                                         \
+    void NAME##_init(NAME* arr, Arena* arena);                                       \
+    void NAME##_initWithCapacity(NAME* arr, Arena* arena, size_t required_capacity); \
+    void NAME##_initFromSlice(NAME* arr, Arena* arena, const T* ptr, size_t len);    \
+    void NAME##_deinit(NAME* arr);                                                   \
+    ARRAY_LIST_COMMON_SIGNATURES_(T, NAME)
+
+#define ARRAY_LIST_HEAP_GROW_(arr, old_size, new_size) reallocChecked((arr)->items, (new_size))
+#define ARRAY_LIST_ARENA_GROW_(arr, old_size, new_size) \
+    Arena_realloc((arr)->arena, (arr)->items, (old_size), (new_size))
+
+#define ARRAY_LIST_COMMON_IMPL_(T, NAME, GROW)                                                    \
     void NAME##_swap(NAME* lhs, NAME* rhs) {                                                      \
         assert(lhs);                                                                              \
         assert(rhs);                                                                              \
@@ -59,11 +65,6 @@
         *lhs = *rhs;                                                                              \
         *rhs = tmp;                                                                               \
     }                                                                                             \
-    void NAME##_deinit(NAME* arr) {                                                               \
-        assert(arr);                                                                              \
-        free(arr->items);                                                                         \
-        *arr = (NAME){0};                                                                         \
-    }                                                                                             \
     void NAME##_clear(NAME* arr) {                                                                \
         assert(arr);                                                                              \
         arr->size = 0;                                                                            \
@@ -71,15 +72,17 @@
     T* NAME##_toOwnedSlice(NAME* arr) {                                                           \
         assert(arr);                                                                              \
         T* ptr = arr->items;                                                                      \
-        NAME##_init(arr);                                                                         \
+        arr->items = NULL;                                                                        \
+        arr->size = 0;                                                                            \
+        arr->cap = 0;                                                                             \
         return ptr;                                                                               \
     }                                                                                             \
     void NAME##_ensureCapacityExact(NAME* arr, size_t required_cap) {                             \
         assert(arr);                                                                              \
         if (arr->cap >= required_cap)                                                             \
             return;                                                                               \
+        arr->items = GROW(arr, sizeof(T) * arr->cap, sizeof(T) * required_cap);                   \
         arr->cap = required_cap;                                                                  \
-        arr->items = reallocChecked(arr->items, sizeof(T) * required_cap);                        \
     }                                                                                             \
     void NAME##_ensureCapacity(NAME* arr, size_t required_cap) {                                  \
         assert(arr);                                                                              \
@@ -151,6 +154,59 @@
         }                                                                                         \
     }
 
+#define ARRAY_LIST_IMPL(T, NAME)                                                                  \
+    void NAME##_init(NAME* arr) {                                                                 \
+        assert(arr);                                                                              \
+        *arr = (NAME){                                                                            \
+            .items = NULL,                                                                        \
+            .cap = 0,                                                                             \
+            .size = 0,                                                                            \
+        };                                                                                        \
+    }                                                                                             \
+    void NAME##_initWithCapacity(NAME* arr, size_t required_capacity) {                           \
+        assert(arr);                                                                              \
+        NAME##_init(arr);                                                                         \
+        NAME##_ensureCapacity(arr, required_capacity);                                            \
+    }                                                                                             \
+    void NAME##_initFromSlice(NAME* arr, const T* ptr, size_t len) {                              \
+        assert(arr);                                                                              \
+        NAME##_initWithCapacity(arr, len);                                                        \
+        NAME##_appendSlice(arr, ptr, len);                                                        \
+    }                                                                                             \
+    void NAME##_deinit(NAME* arr) {                                                               \
+        assert(arr);                                                                              \
+        free(arr->items);                                                                         \
+        *arr = (NAME){0};                                                                         \
+    }                                                                                             \
+    ARRAY_LIST_COMMON_IMPL_(T, NAME, ARRAY_LIST_HEAP_GROW_)
+
+#define ARENA_ARRAY_LIST_IMPL(T, NAME)                                                            \
+    void NAME##_init(NAME* arr, Arena* arena) {                                                   \
+        assert(arr);                                                                              \
+        assert(arena);                                                                            \
+        *arr = (NAME){                                                                            \
+            .items = NULL,                                                                        \
+            .cap = 0,                                                                             \
+            .size = 0,                                                                            \
+            .arena = arena,                                                                       \
+        };                                                                                        \
+    }                                                                                             \
+    void NAME##_initWithCapacity(NAME* arr, Arena* arena, size_t required_capacity) {             \
+        assert(arr);                                                                              \
+        NAME##_init(arr, arena);                                                                  \
+        NAME##_ensureCapacity(arr, required_capacity);                                            \
+    }                                                                                             \
+    void NAME##_initFromSlice(NAME* arr, Arena* arena, const T* ptr, size_t len) {                \
+        assert(arr);                                                                              \
+        NAME##_initWithCapacity(arr, arena, len);                                                 \
+        NAME##_appendSlice(arr, ptr, len);                                                        \
+    }                                                                                             \
+    void NAME##_deinit(NAME* arr) {                                                               \
+        assert(arr);                                                                              \
+        NAME##_toOwnedSlice(arr);                                                                 \
+    }                                                                                             \
+    ARRAY_LIST_COMMON_IMPL_(T, NAME, ARRAY_LIST_ARENA_GROW_)
+
 #define ARRAY_LIST_DEFINITION(T, NAME) \
     ARRAY_LIST_STRUCT(T, NAME)         \
     ARRAY_LIST_SIGNATURES(T, NAME)
@@ -158,3 +214,11 @@
 #define ARRAY_LIST_FULL(T, NAME)   \
     ARRAY_LIST_DEFINITION(T, NAME) \
     ARRAY_LIST_IMPL(T, NAME)
+
+#define ARENA_ARRAY_LIST_DEFINITION(T, NAME) \
+    ARENA_ARRAY_LIST_STRUCT(T, NAME)         \
+    ARENA_ARRAY_LIST_SIGNATURES(T, NAME)
+
+#define ARENA_ARRAY_LIST_FULL(T, NAME)   \
+    ARENA_ARRAY_LIST_DEFINITION(T, NAME) \
+    ARENA_ARRAY_LIST_IMPL(T, NAME)
@@ -0,0 +1,1059 @@
+#include "builtins.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "common.h"
+#include "dyn_string.h"
+#include "jobs.h"
+#include "path_cache.h"
+#include "reaper.h"
+
+/// Output of builtins goes through `stdout`, so a failed write is only noticed when flushing
+static int flushOutput(const char* name) {
+    if (fflush(stdout) == 0) {
+        return 0;
+    }
+    fprintf(stderr, "%s: write error: %s\n", name, strerror(errno));
+    clearerr(stdout);
+    return 1;
+}
+
+static bool isName(const char* s, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)s[0]) || s[0] == '_')) {
+        return false;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if (!(isalnum((unsigned char)s[i]) || s[i] == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int Executor_true(Executor* self, size_t argc, char const* const* argv) {
+    UNUSED(self);
+    UNUSED(argc);
+    UNUSED(argv);
+    return 0;
+}
+
+static int Executor_false(Executor* self, size_t argc, char const* const* argv) {
+    UNUSED(self);
+    UNUSED(argc);
+    UNUSED(argv);
+    return 1;
+}
+
+static int Executor_echo(Executor* self, size_t argc, char const* const* argv) {
+    UNUSED(self);
+    bool newline = true;
+    size_t first = 0;
+    for (; first < argc && strcmp(argv[first], "-n") == 0; ++first) {
+        newline = false;
+    }
+
+    for (size_t i = first; i < argc; ++i) {
+        if (i > first) {
+            putchar(' ');
+        }
+        fputs(argv[i], stdout);
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return flushOutput("echo");
+}
+
+static int Executor_pwd(Executor* self, size_t argc, char const* const* argv) {
+    UNUSED(self);
+    for (size_t i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "-L") != 0 && strcmp(argv[i], "-P") != 0) {
+            fprintf(stderr, "pwd: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+
+    size_t cap = 256;
+    char* buf = mallocChecked(cap);
+    while (!getcwd(buf, cap)) {
+        if (errno != ERANGE) {
+            perror("pwd");
+            free(buf);
+            return 1;
+        }
+        cap *= 2;
+        buf = reallocChecked(buf, cap);
+    }
+    puts(buf);
+    free(buf);
+    return flushOutput("pwd");
+}
+
+static void appendFormatted(String* out, const char* spec, ...) {
+    va_list args;
+    va_start(args, spec);
+    va_list measure;
+    va_copy(measure, args);
+    const int len = vsnprintf(NULL, 0, spec, measure);
+    va_end(measure);
+    if (len > 0) {
+        String_ensureCapacity(out, out->size + (size_t)len + 1);
+        vsnprintf(out->items + out->size, (size_t)len + 1, spec, args);
+        out->size += (size_t)len;
+    }
+    va_end(args);
+}
+
+/// Decodes the escape sequence after a backslash at `*s` and advances past it. Octal escapes are
+/// `\NNN` in the format and `\0NNN` in arguments of `%b`. Returns `false` for `\c`, after which
+/// nothing more is printed
+static bool decodeEscape(const char** s, bool in_arg, String* out) {
+    const char* p = *s;
+    static const char escapes[] = "a\ab\bf\fn\nr\rt\tv\v\\\\";
+    const char* esc;
+    if (*p == 'c' && in_arg) {
+        *s = p + 1;
+        return false;
+    } else if (*p != '\0' && (esc = strchr(escapes, *p)) != NULL && (esc - escapes) % 2 == 0) {
+        String_append(out, esc[1]);
+        *s = p + 1;
+    } else if (*p >= '0' && *p <= '7') {
+        size_t max_digits = 3;
+        if (in_arg && *p == '0') {
+            ++p;
+        }
+        unsigned value = 0;
+        for (; max_digits > 0 && *p >= '0' && *p <= '7'; --max_digits, ++p) {
+            value = value * 8 + (unsigned)(*p - '0');
+        }
+        String_append(out, (char)value);
+        *s = p;
+    } else {
+        // not an escape, kept as it is
+        String_append(out, '\\');
+    }
+    return true;
+}
+
+/// Like the `printf` utility, a leading quote yields the code of the character after it
+static bool parseNumber(const char* s, bool is_signed, long long* value) {
+    if (*s == '\'' || *s == '"') {
+        *value = (unsigned char)s[1];
+        return true;
+    }
+    if (*s == '\0') {
+        *value = 0;
+        return true;
+    }
+    char* end;
+    errno = 0;
+    *value = is_signed ? strtoll(s, &end, 0) : (long long)strtoull(s, &end, 0);
+    return *end == '\0' && errno == 0;
+}
+
+/// Supports the conversions of the `printf` utility: `diouxXcsb` with flags, width and precision
+static int Executor_printf(Executor* self, size_t argc, char const* const* argv) {
+    UNUSED(self);
+    if (argc == 0) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    const char* fmt = argv[0];
+    char const* const* args = argv + 1;
+    const size_t args_size = argc - 1;
+
+    String out;
+    String_init(&out);
+    String arg_buf;
+    String_init(&arg_buf);
+    int res = 0;
+    bool stop = false;
+    size_t used = 0;
+    // the format is reused as long as there are arguments left
+    do {
+        const size_t used_before = used;
+        for (const char* p = fmt; *p && !stop;) {
+            if (*p == '\\') {
+                ++p;
+                decodeEscape(&p, false, &out);
+                continue;
+            } else if (*p != '%') {
+                String_append(&out, *p++);
+                continue;
+            } else if (p[1] == '%') {
+                String_append(&out, '%');
+                p += 2;
+                continue;
+            }
+
+            const char* start = p++;
+            p += strspn(p, "-+ #0");
+            p += strspn(p, "0123456789");
+            if (*p == '.') {
+                ++p;
+                p += strspn(p, "0123456789");
+            }
+            const char conv = *p;
+            if (conv == '\0' || !strchr("diouxXcsb", conv) || p - start > 24) {
+                fprintf(stderr, "printf: `%.*s`: invalid format\n", (int)(p - start + 1), start);
+                res = 1;
+                stop = true;
+                break;
+            }
+            ++p;
+
+            // the conversion is replaced, so there is room for `ll`
+            char spec[32];
+            const size_t prefix_len = (size_t)(p - start - 1);
+            memcpy(spec, start, prefix_len);
+            const char* arg = (used < args_size) ? args[used++] : "";
+            long long number;
+            switch (conv) {
+                case 's':
+                    memcpy(spec + prefix_len, "s", 2);
+                    appendFormatted(&out, spec, arg);
+                    break;
+                case 'c':
+                    memcpy(spec + prefix_len, "s", 2);
+                    appendFormatted(&out, spec, (char[2]){arg[0], '\0'});
+                    break;
+                case 'b':
+                    String_clear(&arg_buf);
+                    for (const char* a = arg; *a && !stop;) {
+                        if (*a == '\\') {
+                            ++a;
+                            stop = !decodeEscape(&a, true, &arg_buf);
+                        } else {
+                            String_append(&arg_buf, *a++);
+                        }
+                    }
+                    String_append(&arg_buf, '\0');
+                    memcpy(spec + prefix_len, "s", 2);
+                    appendFormatted(&out, spec, arg_buf.items);
+                    break;
+                default:
+                    if (!parseNumber(arg, conv == 'd' || conv == 'i', &number)) {
+                        fprintf(stderr, "printf: %s: invalid number\n", arg);
+                        res = 1;
+                    }
+                    memcpy(spec + prefix_len, "ll", 2);
+                    spec[prefix_len + 2] = conv;
+                    spec[prefix_len + 3] = '\0';
+                    appendFormatted(&out, spec, number);
+                    break;
+            }
+        }
+        if (used == used_before) {
+            break;
+        }
+    } while (used < args_size && !stop);
+
+    fwrite(out.items, 1, out.size, stdout);
+    String_deinit(&out);
+    String_deinit(&arg_buf);
+    const int flush_res = flushOutput("printf");
+    return (res != 0) ? res : flush_res;
+}
+
+typedef struct {
+    char const* const* argv;
+    size_t argc;
+    size_t pos;
+    /// set with the message already printed, makes `test` exit with `2`
+    bool error;
+} TestParser;
+
+static const char* TestParser_peek(const TestParser* self, size_t ahead) {
+    return (self->pos + ahead < self->argc) ? self->argv[self->pos + ahead] : NULL;
+}
+
+static bool TestParser_fail(TestParser* self, const char* msg, const char* arg) {
+    if (!self->error) {
+        fprintf(stderr, "test: %s%s%s\n", (arg) ? arg : "", (arg) ? ": " : "", msg);
+    }
+    self->error = true;
+    return false;
+}
+
+static bool isUnaryTestOp(const char* s) {
+    return s[0] == '-' && s[1] != '\0' && s[2] == '\0' && strchr("bcdefghLnprsStwxz", s[1]);
+}
+
+static bool isBinaryTestOp(const char* s) {
+    static const char* const ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef",
+    };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (strcmp(s, ops[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool TestParser_integer(TestParser* self, const char* s, long long* value) {
+    char* end;
+    errno = 0;
+    *value = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end)) {
+        ++end;
+    }
+    if (*s == '\0' || *end != '\0' || errno != 0) {
+        return TestParser_fail(self, "integer expression expected", s);
+    }
+    return true;
+}
+
+static bool TestParser_unary(TestParser* self, char op, const char* arg) {
+    struct stat st;
+    switch (op) {
+        case 'n':
+            return arg[0] != '\0';
+        case 'z':
+            return arg[0] == '\0';
+        case 't': {
+            long long fd;
+            return TestParser_integer(self, arg, &fd) && fd >= 0 && fd <= 0xFFFF &&
+                   isatty((int)fd);
+        }
+        case 'L':
+        case 'h':
+            return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r':
+            return access(arg, R_OK) == 0;
+        case 'w':
+            return access(arg, W_OK) == 0;
+        case 'x':
+            return access(arg, X_OK) == 0;
+        default:
+            break;
+    }
+
+    if (stat(arg, &st) != 0) {
+        return false;
+    }
+    switch (op) {
+        case 'b':
+            return S_ISBLK(st.st_mode);
+        case 'c':
+            return S_ISCHR(st.st_mode);
+        case 'd':
+            return S_ISDIR(st.st_mode);
+        case 'e':
+            return true;
+        case 'f':
+            return S_ISREG(st.st_mode);
+        case 'g':
+            return (st.st_mode & S_ISGID) != 0;
+        case 'p':
+            return S_ISFIFO(st.st_mode);
+        case 's':
+            return st.st_size > 0;
+        case 'S':
+            return S_ISSOCK(st.st_mode);
+        case 'u':
+            return (st.st_mode & S_ISUID) != 0;
+        default:
+            assert(0);
+            return false;
+    }
+}
+
+static bool isNewer(const struct stat* lhs, const struct stat* rhs) {
+    if (lhs->st_mtim.tv_sec != rhs->st_mtim.tv_sec) {
+        return lhs->st_mtim.tv_sec > rhs->st_mtim.tv_sec;
+    }
+    return lhs->st_mtim.tv_nsec > rhs->st_mtim.tv_nsec;
+}
+
+static bool TestParser_binary(TestParser* self, const char* lhs, const char* op, const char* rhs) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(lhs, rhs) == 0;
+    } else if (strcmp(op, "!=") == 0) {
+        return strcmp(lhs, rhs) != 0;
+    } else if (strcmp(op, "<") == 0) {
+        return strcmp(lhs, rhs) < 0;
+    } else if (strcmp(op, ">") == 0) {
+        return strcmp(lhs, rhs) > 0;
+    }
+
+    const bool newer = strcmp(op, "-nt") == 0;
+    const bool older = strcmp(op, "-ot") == 0;
+    if (newer || older || strcmp(op, "-ef") == 0) {
+        struct stat l, r;
+        const bool has_l = stat(lhs, &l) == 0;
+        const bool has_r = stat(rhs, &r) == 0;
+        if (newer) {
+            return has_l && (!has_r || isNewer(&l, &r));
+        } else if (older) {
+            return has_r && (!has_l || isNewer(&r, &l));
+        }
+        return has_l && has_r && l.st_dev == r.st_dev && l.st_ino == r.st_ino;
+    }
+
+    long long l, r;
+    if (!TestParser_integer(self, lhs, &l) || !TestParser_integer(self, rhs, &r)) {
+        return false;
+    }
+    switch (op[1] * 256 + op[2]) {
+        case 'e' * 256 + 'q':
+            return l == r;
+        case 'n' * 256 + 'e':
+            return l != r;
+        case 'l' * 256 + 't':
+            return l < r;
+        case 'l' * 256 + 'e':
+            return l <= r;
+        case 'g' * 256 + 't':
+            return l > r;
+        default:
+            return l >= r;
+    }
+}
+
+static bool TestParser_or(TestParser* self);
+
+static bool TestParser_primary(TestParser* self) {
+    const char* arg = TestParser_peek(self, 0);
+    if (!arg) {
+        return TestParser_fail(self, "argument expected", NULL);
+    }
+
+    const char* op = TestParser_peek(self, 1);
+    if (op && TestParser_peek(self, 2) && isBinaryTestOp(op)) {
+        self->pos += 3;
+        return TestParser_binary(self, arg, op, self->argv[self->pos - 1]);
+    }
+    if (strcmp(arg, "(") == 0 && op) {
+        self->pos += 1;
+        const bool res = TestParser_or(self);
+        const char* close = TestParser_peek(self, 0);
+        if (!close || strcmp(close, ")") != 0) {
+            return TestParser_fail(self, "`)` expected", NULL);
+        }
+        self->pos += 1;
+        return res;
+    }
+    if (op && isUnaryTestOp(arg)) {
+        self->pos += 2;
+        return TestParser_unary(self, arg[1], op);
+    }
+    self->pos += 1;
+    return arg[0] != '\0';
+}
+
+static bool TestParser_not(TestParser* self) {
+    const char* arg = TestParser_peek(self, 0);
+    // a lone `!` is just a non-empty string
+    if (arg && strcmp(arg, "!") == 0 && TestParser_peek(self, 1)) {
+        self->pos += 1;
+        return !TestParser_not(self);
+    }
+    return TestParser_primary(self);
+}
+
+static bool TestParser_and(TestParser* self) {
+    bool res = TestParser_not(self);
+    const char* op;
+    while ((op = TestParser_peek(self, 0)) && strcmp(op, "-a") == 0) {
+        self->pos += 1;
+        // both sides are parsed, so syntax errors are found even if the result is known
+        res = TestParser_not(self) && res;
+    }
+    return res;
+}
+
+static bool TestParser_or(TestParser* self) {
+    bool res = TestParser_and(self);
+    const char* op;
+    while ((op = TestParser_peek(self, 0)) && strcmp(op, "-o") == 0) {
+        self->pos += 1;
+        res = TestParser_and(self) || res;
+    }
+    return res;
+}
+
+static int Executor_test(Executor* self, size_t argc, char const* const* argv) {
+    UNUSED(self);
+    if (argc == 0) {
+        return 1;
+    }
+
+    TestParser parser = {.argv = argv, .argc = argc, .pos = 0, .error = false};
+    const bool res = TestParser_or(&parser);
+    if (!parser.error && parser.pos != argc) {
+        TestParser_fail(&parser, "too many arguments", NULL);
+    }
+    if (parser.error) {
+        return 2;
+    }
+    return res ? 0 : 1;
+}
+
+static int Executor_bracket(Executor* self, size_t argc, char const* const* argv) {
+    if (argc == 0 || strcmp(argv[argc - 1], "]") != 0) {
+        fprintf(stderr, "[: missing `]`\n");
+        return 2;
+    }
+    return Executor_test(self, argc - 1, argv);
+}
+
+static int Executor_export(Executor* self, size_t argc, char const* const* argv) {
+    if (argc == 0 || (argc == 1 && strcmp(argv[0], "-p") == 0)) {
+        Vars_printExported(&self->vars, stdout);
+        return flushOutput("export");
+    }
+
+    int res = 0;
+    for (size_t i = 0; i < argc; ++i) {
+        const char* eq = strchr(argv[i], '=');
+        const size_t name_len = (eq) ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!isName(argv[i], name_len)) {
+            fprintf(stderr, "export: `%s`: not a valid identifier\n", argv[i]);
+            res = 1;
+            continue;
+        }
+        if (eq) {
+            Executor_setVar(self, argv[i], name_len, eq + 1, strlen(eq + 1), true);
+        }
+        // unlike in other shells, exporting a variable that is not set is ignored
+        Executor_exportVar(self, argv[i], name_len);
+    }
+    return res;
+}
+
+static int Executor_unset(Executor* self, size_t argc, char const* const* argv) {
+    size_t first = 0;
+    if (argc > 0 && strcmp(argv[0], "-v") == 0) {
+        first = 1;
+    } else if (argc > 0 && strcmp(argv[0], "-f") == 0) {
+        // there are no functions
+        return 0;
+    }
+
+    int res = 0;
+    for (size_t i = first; i < argc; ++i) {
+        const size_t len = strlen(argv[i]);
+        if (!isName(argv[i], len)) {
+            fprintf(stderr, "unset: `%s`: not a valid identifier\n", argv[i]);
+            res = 1;
+            continue;
+        }
+        Executor_unsetVar(self, argv[i], len);
+    }
+    return res;
+}
+
+static int Executor_cd(Executor* self, size_t argc, char const* const* argv) {
+    if (argc > 1) {
+        fprintf(stderr, "Expected 1 or less arguments, got %zu\n", argc);
+        return 1;
+    }
+
+    const char* path = NULL;
+    if (argc == 0) {
+        path = Executor_getVarCStr(self, "HOME");
+    } else if (argc == 1) {
+        path = argv[0];
+    }
+
+    if (chdir(path) == -1) {
+        perror("cd");
+        return 1;
+    }
+    Executor_setVarCStrs(self, "PWD", path, true);
+    return 0;
+}
+
+static int Executor_hash(Executor* self, size_t argc, char const* const* argv) {
+    if (argc == 0) {
+        PathCache_print(&self->path_cache, stdout);
+        fflush(stdout);
+        return 0;
+    }
+    if (argc == 1 && strcmp(argv[0], "-r") == 0) {
+        PathCache_clear(&self->path_cache);
+        return 0;
+    }
+
+    int res = 0;
+    const char* path_var = Executor_getVarCStr(self, "PATH");
+    for (size_t i = 0; i < argc; ++i) {
+        if (strchr(argv[i], '/') != NULL) {
+            continue;
+        }
+        if (!PathCache_lookup(&self->path_cache, path_var, argv[i])) {
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            res = 1;
+        }
+    }
+    return res;
+}
+
+static int Executor_set(Executor* self, size_t argc, char const* const* argv) {
+    if (argc == 2 && strcmp(argv[1], "pipefail") == 0 &&
+        (strcmp(argv[0], "-o") == 0 || strcmp(argv[0], "+o") == 0)) {
+        self->pipefail = argv[0][0] == '-';
+        return 0;
+    }
+
+    fprintf(stderr, "set: only `-o pipefail` and `+o pipefail` are supported\n");
+    return 2;
+}
+
+static int Executor_jobs(Executor* self, size_t argc, char const* const* argv) {
+    UNUSED(argv);
+    if (argc != 0) {
+        fprintf(stderr, "jobs: options are not supported\n");
+        return 2;
+    }
+    JobTable_reap(&self->jobs, self->pipefail);
+    JobTable_print(&self->jobs, stdout, false);
+    return 0;
+}
+
+/// Accepts `%n` for the job with number `n` and plain numbers for process ids
+static bool parseJobId(const char* s, bool* is_job, size_t* id) {
+    *is_job = *s == '%';
+    if (*is_job) {
+        ++s;
+    }
+    if (!isdigit((unsigned char)*s)) {
+        return false;
+    }
+    char* end;
+    unsigned long long res = strtoull(s, &end, 10);
+    *id = (size_t)res;
+    return *end == '\0';
+}
+
+static int Executor_wait(Executor* self, size_t argc, char const* const* argv) {
+    JobTable* jobs = &self->jobs;
+    if (argc == 0) {
+        JobTable_waitAll(jobs, self->pipefail);
+        return 0;
+    }
+    if (argc == 1 && strcmp(argv[0], "-n") == 0) {
+        int exit_code;
+        return JobTable_waitAny(jobs, self->pipefail, &exit_code) ? exit_code : 127;
+    }
+
+    int res = 0;
+    for (size_t i = 0; i < argc; ++i) {
+        bool is_job;
+        size_t id;
+        if (!parseJobId(argv[i], &is_job, &id)) {
+            fprintf(stderr, "wait: `%s`: not a pid or valid job spec\n", argv[i]);
+            res = 2;
+        } else if (is_job ? !JobTable_waitJob(jobs, id, self->pipefail, &res)
+                          : !JobTable_waitPid(jobs, (pid_t)id, self->pipefail, &res)) {
+            fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+            res = 127;
+        }
+    }
+    return res;
+}
+
+ARRAY_LIST_FULL(const char*, Items)
+
+#define PARALLEL_READ_CHUNK 65536
+/// like in GNU parallel, the exit code counts failed jobs up to this
+#define PARALLEL_MAX_FAILED 101
+
+typedef struct {
+    bool active;
+    pid_t pid;
+    /// read end of the job's stdout, `-1` once it is exhausted
+    int fd;
+    /// collected until the job exits, so outputs of different jobs are not interleaved
+    String output;
+} ParallelSlot;
+
+/// `{}` in the words of `tmpl` is replaced with `item`, without any it is appended instead
+static char** parallelArgs(char const* const* tmpl, size_t tmpl_size, const char* item,
+                           size_t* argc) {
+    bool has_placeholder = false;
+    for (size_t i = 0; i < tmpl_size && !has_placeholder; ++i) {
+        has_placeholder = strstr(tmpl[i], "{}") != NULL;
+    }
+    *argc = tmpl_size + !has_placeholder;
+    char** args = mallocChecked((*argc + 1) * sizeof(char*));
+
+    const size_t item_len = strlen(item);
+    String arg;
+    for (size_t i = 0; i < tmpl_size; ++i) {
+        String_init(&arg);
+        const char* s = tmpl[i];
+        const char* placeholder;
+        while ((placeholder = strstr(s, "{}")) != NULL) {
+            String_appendSlice(&arg, s, (size_t)(placeholder - s));
+            String_appendSlice(&arg, item, item_len);
+            s = placeholder + 2;
+        }
+        String_appendSlice(&arg, s, strlen(s) + 1);
+        args[i] = String_toOwnedSlice(&arg);
+    }
+    if (!has_placeholder) {
+        String_init(&arg);
+        String_appendSlice(&arg, item, item_len + 1);
+        args[tmpl_size] = String_toOwnedSlice(&arg);
+    }
+    args[*argc] = NULL;
+    return args;
+}
+
+static void freeArgs(char** args) {
+    for (char** arg = args; *arg; ++arg) {
+        free(*arg);
+    }
+    free(args);
+}
+
+/// Returns `false` once the job's stdout is exhausted
+static bool ParallelSlot_read(ParallelSlot* self) {
+    String_ensureCapacity(&self->output, self->output.size + PARALLEL_READ_CHUNK);
+    ssize_t n;
+    while ((n = read(self->fd, self->output.items + self->output.size, PARALLEL_READ_CHUNK)) ==
+               -1 &&
+           errno == EINTR) {
+    }
+    if (n <= 0) {
+        close(self->fd);
+        self->fd = -1;
+        return false;
+    }
+    self->output.size += (size_t)n;
+    return true;
+}
+
+/// Keeps up to `jobs` commands running, a slot is refilled as soon as its job exits
+static int Executor_runParallel(Executor* self, char const* const* tmpl, size_t tmpl_size,
+                                const char* const* items, size_t items_size, size_t jobs) {
+    if (jobs > items_size) {
+        jobs = items_size;
+    }
+    ParallelSlot* slots = callocChecked(jobs, sizeof(ParallelSlot));
+    for (size_t i = 0; i < jobs; ++i) {
+        String_init(&slots[i].output);
+    }
+    struct pollfd* pfds = mallocChecked((jobs + 1) * sizeof(struct pollfd));
+    size_t* pfd_slots = mallocChecked(jobs * sizeof(size_t));
+
+    size_t next = 0;
+    size_t running = 0;
+    size_t failed = 0;
+    while (next < items_size || running > 0) {
+        for (size_t i = 0; i < jobs; ++i) {
+            while (!slots[i].active && next < items_size) {
+                size_t argc;
+                char** args = parallelArgs(tmpl, tmpl_size, items[next++], &argc);
+                int exit_code;
+                slots[i].pid = Executor_startCommand(self, args, argc, &slots[i].fd, &exit_code);
+                freeArgs(args);
+                if (slots[i].pid == -1) {
+                    failed += exit_code != 0;
+                    continue;
+                }
+                slots[i].active = true;
+                running += 1;
+            }
+        }
+        if (running == 0) {
+            break;
+        }
+
+        size_t nfds = 0;
+        for (size_t i = 0; i < jobs; ++i) {
+            if (slots[i].active && slots[i].fd != -1) {
+                pfd_slots[nfds] = i;
+                pfds[nfds++] = (struct pollfd){.fd = slots[i].fd, .events = POLLIN};
+            }
+        }
+        // jobs can exit after closing their stdout, or keep it open in their own children
+        pfds[nfds] = (struct pollfd){.fd = Reaper_fd(), .events = POLLIN};
+        if (poll(pfds, nfds + 1, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("parallel");
+            break;
+        }
+        for (size_t i = 0; i < nfds; ++i) {
+            if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ParallelSlot_read(&slots[pfd_slots[i]]);
+            }
+        }
+        if (pfds[nfds].revents & POLLIN) {
+            Reaper_drain();
+        }
+
+        for (size_t i = 0; i < jobs; ++i) {
+            ParallelSlot* slot = &slots[i];
+            int exit_code;
+            if (!slot->active || slot->fd != -1 ||
+                !Executor_tryWaitChild(self, slot->pid, &exit_code)) {
+                continue;
+            }
+            fwrite(slot->output.items, 1, slot->output.size, stdout);
+            fflush(stdout);
+            String_clear(&slot->output);
+            slot->active = false;
+            running -= 1;
+            failed += exit_code != 0;
+        }
+    }
+
+    for (size_t i = 0; i < jobs; ++i) {
+        String_deinit(&slots[i].output);
+    }
+    free(slots);
+    free(pfds);
+    free(pfd_slots);
+    return (int)((failed < PARALLEL_MAX_FAILED) ? failed : PARALLEL_MAX_FAILED);
+}
+
+/// Reads one item per line, `items` point into `buf`
+static void readItems(FILE* f, String* buf, Items* items) {
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        String_appendSlice(buf, chunk, n);
+    }
+    clearerr(f);
+    if (buf->size > 0 && buf->items[buf->size - 1] != '\n') {
+        String_append(buf, '\n');
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i < buf->size; ++i) {
+        if (buf->items[i] == '\n') {
+            buf->items[i] = '\0';
+            Items_append(items, buf->items + start);
+            start = i + 1;
+        }
+    }
+}
+
+static bool parseJobCount(const char* s, size_t* jobs) {
+    char* end;
+    unsigned long res = strtoul(s, &end, 10);
+    *jobs = (size_t)res;
+    return *s != '\0' && *end == '\0' && res > 0;
+}
+
+/// `parallel [-j N] cmd [args...] [::: items...]`, items are read from stdin without `:::`.
+/// Runs `N` jobs at a time, the number of CPUs by default. Only stdout is grouped per job, the
+/// jobs share the shell's stderr, so their error messages may interleave
+static int Executor_parallel(Executor* self, size_t argc, char const* const* argv) {
+    size_t jobs = 0;
+    size_t i = 0;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            ++i;
+            break;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc &&
+                   parseJobCount(argv[i + 1], &jobs)) {
+            ++i;
+        } else if (strncmp(argv[i], "-j", 2) != 0 || !parseJobCount(argv[i] + 2, &jobs)) {
+            fprintf(stderr, "parallel: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+    if (jobs == 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = (cpus > 0) ? (size_t)cpus : 1;
+    }
+
+    const size_t cmd_start = i;
+    while (i < argc && strcmp(argv[i], ":::") != 0) {
+        ++i;
+    }
+    if (i == cmd_start) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] command [args...] [::: items...]\n");
+        return 2;
+    }
+
+    Items items;
+    Items_init(&items);
+    String buf;
+    String_init(&buf);
+    if (i == argc) {
+        readItems(stdin, &buf, &items);
+    } else {
+        for (size_t j = i + 1; j < argc; ++j) {
+            Items_append(&items, argv[j]);
+        }
+    }
+
+    fflush(stdout);
+    const int res =
+        Executor_runParallel(self, argv + cmd_start, i - cmd_start, items.items, items.size, jobs);
+    String_deinit(&buf);
+    Items_deinit(&items);
+    return res;
+}
+
+static int compareSeconds(const void* lhs, const void* rhs) {
+    const double a = *(const double*)lhs;
+    const double b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+static void printDuration(FILE* f, double seconds) {
+    if (seconds < 1e-3) {
+        fprintf(f, "%.1fus", seconds * 1e6);
+    } else if (seconds < 1) {
+        fprintf(f, "%.3fms", seconds * 1e3);
+    } else {
+        fprintf(f, "%.3fs", seconds);
+    }
+}
+
+/// `sorted` has `n` elements, the nearest rank is used
+static void printPercentile(FILE* f, const double* sorted, size_t n, size_t percent) {
+    size_t rank = (percent * n + 99) / 100;
+    rank = (rank == 0) ? 1 : rank;
+    fprintf(f, "p%zu\t", percent);
+    printDuration(f, sorted[rank - 1]);
+    fprintf(f, "\n");
+}
+
+/// `bench [-n N] cmd [args...]`, runs the command `N` times, 10 by default, and reports the
+/// distribution of its wall time and its mean CPU time. Stops at the first failing run
+static int Executor_bench(Executor* self, size_t argc, char const* const* argv) {
+    size_t runs = 10;
+    size_t i = 0;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            ++i;
+            break;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc &&
+                   parseJobCount(argv[i + 1], &runs)) {
+            ++i;
+        } else if (strncmp(argv[i], "-n", 2) != 0 || !parseJobCount(argv[i] + 2, &runs)) {
+            fprintf(stderr, "bench: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+    if (i == argc) {
+        fprintf(stderr, "bench: usage: bench [-n N] command [args...]\n");
+        return 2;
+    }
+
+    const size_t cmd_argc = argc - i;
+    char** args = mallocChecked((cmd_argc + 1) * sizeof(char*));
+    for (size_t j = 0; j < cmd_argc; ++j) {
+        const size_t len = strlen(argv[i + j]);
+        args[j] = mallocChecked(len + 1);
+        memcpy(args[j], argv[i + j], len + 1);
+    }
+    args[cmd_argc] = NULL;
+
+    double* real = mallocChecked(runs * sizeof(double));
+    double user = 0;
+    double sys = 0;
+    long max_rss = 0;
+    int code = 0;
+    size_t done = 0;
+    for (; done < runs; ++done) {
+        fflush(stdout);
+        UsageStart start;
+        Executor_startUsage(self, &start);
+        code = Executor_runArgs(self, args, cmd_argc);
+        fflush(stdout);
+        const Usage usage = Executor_finishUsage(self, &start);
+        if (code != 0) {
+            fprintf(stderr, "bench: run %zu exited with %d\n", done + 1, code);
+            break;
+        }
+        real[done] = usage.real;
+        user += usage.user;
+        sys += usage.sys;
+        max_rss = (usage.max_rss > max_rss) ? usage.max_rss : max_rss;
+    }
+    freeArgs(args);
+
+    if (done > 0) {
+        double mean = 0;
+        for (size_t j = 0; j < done; ++j) {
+            mean += real[j];
+        }
+        mean /= (double)done;
+        double variance = 0;
+        for (size_t j = 0; j < done; ++j) {
+            variance += (real[j] - mean) * (real[j] - mean);
+        }
+        variance = (done > 1) ? variance / (double)(done - 1) : 0;
+        qsort(real, done, sizeof(double), compareSeconds);
+
+        fprintf(stderr, "runs\t%zu\nmean\t", done);
+        printDuration(stderr, mean);
+        fprintf(stderr, " +- ");
+        printDuration(stderr, sqrt(variance));
+        fprintf(stderr, "\nmin\t");
+        printDuration(stderr, real[0]);
+        fprintf(stderr, "\n");
+        printPercentile(stderr, real, done, 50);
+        printPercentile(stderr, real, done, 90);
+        printPercentile(stderr, real, done, 99);
+        fprintf(stderr, "max\t");
+        printDuration(stderr, real[done - 1]);
+        fprintf(stderr, "\nuser\t");
+        printDuration(stderr, user / (double)done);
+        fprintf(stderr, " per run\nsys\t");
+        printDuration(stderr, sys / (double)done);
+        fprintf(stderr, " per run\n");
+        if (max_rss > 0) {
+            fprintf(stderr, "maxrss\t%ldK\n", max_rss);
+        }
+    }
+    free(real);
+    return code;
+}
+
+/// sorted by name for `bsearch`
+static const BuiltinEntry builtins[] = {
+    {"[", Executor_bracket, true},
+    {"bench", Executor_bench, false},
+    {"cd", Executor_cd, false},
+    {"echo", Executor_echo, true},
+    {"export", Executor_export, false},
+    {"false", Executor_false, true},
+    {"hash", Executor_hash, false},
+    {"jobs", Executor_jobs, false},
+    {"parallel", Executor_parallel, false},
+    {"printf", Executor_printf, true},
+    {"pwd", Executor_pwd, true},
+    {"set", Executor_set, false},
+    {"test", Executor_test, true},
+    {"true", Executor_true, true},
+    {"unset", Executor_unset, false},
+    {"wait", Executor_wait, false},
+};
+
+static int compareBuiltin(const void* name, const void* entry) {
+    return strcmp(name, ((const BuiltinEntry*)entry)->name);
+}
+
+const BuiltinEntry* Builtin_find(const char* name) {
+    return bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]), sizeof(builtins[0]),
+                   compareBuiltin);
+}
+
+const BuiltinEntry* Builtin_all(size_t* count) {
+    *count = sizeof(builtins) / sizeof(builtins[0]);
+    return builtins;
+}
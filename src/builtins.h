@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "executor.h"
+
+/// `argv` holds the arguments after the name of the builtin. Returns the exit code
+typedef int (*Builtin)(Executor* self, size_t argc, char const* const* argv);
+
+typedef struct {
+    const char* name;
+    Builtin run;
+    /// leaves the state of the shell alone, so it can run in the shell even where other shells
+    /// use a subshell, e.g. in a command substitution
+    bool pure;
+} BuiltinEntry;
+
+/// Returns `NULL` if `name` is not a builtin
+const BuiltinEntry* Builtin_find(const char* name);
+
+/// All builtins sorted by name, stores how many there are in `count`
+const BuiltinEntry* Builtin_all(size_t* count);
@@ -1,3 +1,16 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define UNUSED(x) (void)(x)
+
+/// FNV-1a
+static inline size_t hashBytes(const char* s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
+}
@@ -0,0 +1,215 @@
+#include "completion.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "alloc.h"
+#include "builtins.h"
+#include "dyn_string.h"
+
+ARRAY_LIST_SIGNATURES(Candidate, Candidates)
+ARRAY_LIST_IMPL(Candidate, Candidates)
+ARRAY_LIST_SIGNATURES(DirEntry, DirEntries)
+ARRAY_LIST_IMPL(DirEntry, DirEntries)
+
+void Completer_init(Completer* self) {
+    assert(self);
+    for (size_t i = 0; i < COMPLETION_CACHED_DIRS; ++i) {
+        self->dirs[i] = (ListedDir){.path = NULL, .used_at = 0};
+        DirEntries_init(&self->dirs[i].entries);
+    }
+    self->clock = 0;
+    Candidates_init(&self->candidates);
+}
+
+static void ListedDir_clear(ListedDir* self) {
+    free(self->path);
+    self->path = NULL;
+    for (size_t i = 0; i < self->entries.size; ++i) {
+        free(self->entries.items[i].name);
+    }
+    DirEntries_clear(&self->entries);
+}
+
+void Completer_deinit(Completer* self) {
+    for (size_t i = 0; i < COMPLETION_CACHED_DIRS; ++i) {
+        ListedDir_clear(&self->dirs[i]);
+        DirEntries_deinit(&self->dirs[i].entries);
+    }
+    Candidates_deinit(&self->candidates);
+}
+
+static int compareEntries(const void* lhs, const void* rhs) {
+    return strcmp(((const DirEntry*)lhs)->name, ((const DirEntry*)rhs)->name);
+}
+
+static void ListedDir_read(ListedDir* self, const char* path, const struct timespec* mtime) {
+    ListedDir_clear(self);
+    const size_t path_len = strlen(path);
+    self->path = mallocChecked(path_len + 1);
+    memcpy(self->path, path, path_len + 1);
+    self->mtime = *mtime;
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        struct stat st;
+        const bool is_dir = fstatat(dirfd(dir), name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        const size_t len = strlen(name);
+        DirEntry item = {.name = mallocChecked(len + 1), .is_dir = is_dir};
+        memcpy(item.name, name, len + 1);
+        DirEntries_append(&self->entries, item);
+    }
+    closedir(dir);
+    if (self->entries.size > 0) {
+        qsort(self->entries.items, self->entries.size, sizeof(DirEntry), compareEntries);
+    }
+}
+
+/// Returns the listing of `path`, reading it only if it is not cached or the directory changed
+static const DirEntries* Completer_listDir(Completer* self, const char* path) {
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+
+    self->clock += 1;
+    ListedDir* slot = &self->dirs[0];
+    for (size_t i = 0; i < COMPLETION_CACHED_DIRS; ++i) {
+        ListedDir* dir = &self->dirs[i];
+        if (dir->path != NULL && strcmp(dir->path, path) == 0) {
+            slot = dir;
+            break;
+        }
+        if (dir->path == NULL || (slot->path != NULL && dir->used_at < slot->used_at)) {
+            slot = dir;
+        }
+    }
+
+    if (slot->path == NULL || strcmp(slot->path, path) != 0 ||
+        slot->mtime.tv_sec != st.st_mtim.tv_sec || slot->mtime.tv_nsec != st.st_mtim.tv_nsec) {
+        ListedDir_read(slot, path, &st.st_mtim);
+    }
+    slot->used_at = self->clock;
+    return &slot->entries;
+}
+
+static bool isWordBreak(char c) {
+    return c == ' ' || c == '\t' || strchr("|&;<>()`", c) != NULL;
+}
+
+/// Whether the word starting at `start` is where a command name goes
+static bool isCommandPosition(const char* line, size_t start) {
+    while (start > 0 && (line[start - 1] == ' ' || line[start - 1] == '\t')) {
+        start -= 1;
+    }
+    return start == 0 || strchr("|&;(`", line[start - 1]) != NULL;
+}
+
+static bool startsWith(const char* s, const char* prefix, size_t len) {
+    return strncmp(s, prefix, len) == 0;
+}
+
+/// Builtins and executables are both sorted, so they are merged without repeating the names
+/// that are both
+static void Completer_completeCommand(Completer* self, Executor* executor, const char* prefix,
+                                      size_t len) {
+    size_t builtins_size;
+    const BuiltinEntry* builtins = Builtin_all(&builtins_size);
+    char* const* found;
+    const size_t found_size = PathCache_complete(
+        &executor->path_cache, Executor_getVarCStr(executor, "PATH"), prefix, len, &found);
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < builtins_size || j < found_size) {
+        if (i < builtins_size && !startsWith(builtins[i].name, prefix, len)) {
+            i += 1;
+            continue;
+        }
+
+        const int cmp = (i == builtins_size) ? 1
+                        : (j == found_size)  ? -1
+                                             : strcmp(builtins[i].name, found[j]);
+        const char* name = (cmp <= 0) ? builtins[i].name : found[j];
+        Candidates_append(&self->candidates, (Candidate){.name = name, .is_dir = false});
+        i += (cmp <= 0) ? 1 : 0;
+        j += (cmp >= 0) ? 1 : 0;
+    }
+}
+
+static void Completer_completeFile(Completer* self, Executor* executor, const char* word,
+                                   size_t len, size_t* start) {
+    size_t dir_len = len;
+    while (dir_len > 0 && word[dir_len - 1] != '/') {
+        dir_len -= 1;
+    }
+    const char* base = word + dir_len;
+    const size_t base_len = len - dir_len;
+    *start += dir_len;
+
+    String path;
+    String_init(&path);
+    const char* home = Executor_getVarCStr(executor, "HOME");
+    if (dir_len == 0) {
+        String_append(&path, '.');
+    } else if (dir_len >= 2 && word[0] == '~' && word[1] == '/' && home != NULL) {
+        String_appendSlice(&path, home, strlen(home));
+        String_appendSlice(&path, word + 1, dir_len - 1);
+    } else {
+        String_appendSlice(&path, word, dir_len);
+    }
+    String_append(&path, '\0');
+
+    const DirEntries* entries = Completer_listDir(self, path.items);
+    String_deinit(&path);
+    if (entries == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < entries->size; ++i) {
+        const DirEntry* entry = &entries->items[i];
+        // hidden files only when asked for
+        if ((entry->name[0] == '.' && (base_len == 0 || base[0] != '.')) ||
+            !startsWith(entry->name, base, base_len)) {
+            continue;
+        }
+        Candidates_append(&self->candidates,
+                          (Candidate){.name = entry->name, .is_dir = entry->is_dir});
+    }
+}
+
+const Candidates* Completer_complete(Completer* self, Executor* executor, const char* line,
+                                     size_t cursor, size_t* start) {
+    assert(self);
+    Candidates_clear(&self->candidates);
+
+    size_t word_start = cursor;
+    while (word_start > 0 && !isWordBreak(line[word_start - 1])) {
+        word_start -= 1;
+    }
+    const char* word = line + word_start;
+    const size_t len = cursor - word_start;
+    *start = word_start;
+
+    bool has_slash = false;
+    for (size_t i = 0; i < len; ++i) {
+        has_slash = has_slash || word[i] == '/';
+    }
+    if (!has_slash && isCommandPosition(line, word_start)) {
+        Completer_completeCommand(self, executor, word, len);
+    } else {
+        Completer_completeFile(self, executor, word, len, start);
+    }
+    return &self->candidates;
+}
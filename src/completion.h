@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "array_list.h"
+#include "executor.h"
+
+typedef struct {
+    /// owned by the cache it comes from, valid until the next completion
+    const char* name;
+    /// directories are completed with a `/` instead of a space
+    bool is_dir;
+} Candidate;
+
+ARRAY_LIST_STRUCT(Candidate, Candidates)
+
+typedef struct {
+    char* name;
+    bool is_dir;
+} DirEntry;
+
+ARRAY_LIST_STRUCT(DirEntry, DirEntries)
+
+typedef struct {
+    /// `NULL` for a free slot
+    char* path;
+    struct timespec mtime;
+    /// sorted by name
+    DirEntries entries;
+    /// value of the completer's clock when the listing was last used
+    size_t used_at;
+} ListedDir;
+
+#define COMPLETION_CACHED_DIRS 8
+
+/// Completes commands from the builtins and the index of `PATH` the path cache keeps, and file
+/// names from the listings of the last few directories completed in. The least recently used
+/// listing is replaced by a new one, and a listing is read again only when its directory changes
+typedef struct {
+    ListedDir dirs[COMPLETION_CACHED_DIRS];
+    size_t clock;
+    Candidates candidates;
+} Completer;
+
+void Completer_init(Completer* self);
+void Completer_deinit(Completer* self);
+
+/// Finds what the word ending at `cursor` in `line` can be completed to, sorted by name. Stores
+/// where the part of the word the candidates replace starts, after the last `/` for file names
+const Candidates* Completer_complete(Completer* self, Executor* executor, const char* line,
+                                     size_t cursor, size_t* start);
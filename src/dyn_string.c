@@ -1,3 +1,4 @@
 #include "dyn_string.h"
 
 ARRAY_LIST_IMPL(char, String)
+ARENA_ARRAY_LIST_IMPL(char, ArenaString)
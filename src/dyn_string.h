@@ -2,3 +2,4 @@
 
 #include "array_list.h"
 ARRAY_LIST_DEFINITION(char, String)
+ARENA_ARRAY_LIST_DEFINITION(char, ArenaString)
@@ -1,506 +1,1282 @@
+// for `F_SETPIPE_SZ`
+#define _GNU_SOURCE
 #include "executor.h"
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "builtins.h"
+#include "common.h"
 #include "dyn_string.h"
+#include "reaper.h"
+#include "trace.h"
 
-ARRAY_LIST_FULL(char*, Strings)
+ARENA_ARRAY_LIST_FULL(char*, ArenaStrings)
+ARRAY_LIST_SIGNATURES(pid_t, Pids)
+ARRAY_LIST_IMPL(pid_t, Pids)
+ARRAY_LIST_SIGNATURES(int, Fds)
+ARRAY_LIST_IMPL(int, Fds)
 
-typedef enum {
-    TokenKind_Whitespace,
-    TokenKind_Comment,
-    TokenKind_EqSign,
-    TokenKind_String,
-    TokenKind_Tilda,
-    TokenKind_VariableReference,
-    TokenKind_LastExitCodeReq,
-} TokenKind;
+void Executor_init(Executor* self) {
+    Vars_init(&self->vars);
+    PathCache_init(&self->path_cache);
+    Arena_init(&self->arena);
+    Arena_init(&self->program_arena);
+    self->parser = NULL;
+    self->script_path = NULL;
+    Reaper_install();
+    self->last_exit_code = 0;
+    self->pipefail = false;
+    Pids_init(&self->children);
+    JobTable_init(&self->jobs);
+    Fds_init(&self->capture_fds);
+    self->capture_depth = 0;
+    self->substituted = false;
+    memset(&self->child_usage, 0, sizeof(self->child_usage));
+}
 
-typedef struct {
-    TokenKind kind;
-} Token;
+void Executor_deinit(Executor* self) {
+    Vars_deinit(&self->vars);
+    PathCache_deinit(&self->path_cache);
+    Arena_deinit(&self->arena);
+    Arena_deinit(&self->program_arena);
+    Pids_deinit(&self->children);
+    JobTable_deinit(&self->jobs);
+    for (size_t i = 0; i < self->capture_fds.size; ++i) {
+        close(self->capture_fds.items[i]);
+    }
+    Fds_deinit(&self->capture_fds);
+}
 
-typedef struct {
-    const char* s;
-    size_t len;
-    size_t cur;
-} Tokenizer;
-
-static void Tokenizer_init(Tokenizer* self, const char* input, const size_t len) {
-    *self = (Tokenizer){
-        .s = input,
-        .len = len,
-        .cur = 0,
-    };
+const char* Executor_getVarCStr(Executor* self, const char* name) {
+    return Vars_get(&self->vars, name, strlen(name));
 }
 
-static int Tokenizer_peekChar(const Tokenizer* self) {
-    if (self->cur >= self->len) {
-        return EOF;
-    }
-    return self->s[self->cur];
+const char* Executor_getVar(Executor* self, const char* name, size_t len) {
+    return Vars_get(&self->vars, name, len);
 }
 
-static int Tokenizer_eatChar(Tokenizer* self) {
-    int res;
-    if ((res = Tokenizer_peekChar(self)) != EOF) {
-        self->cur += 1;
+/// Resolved executables are only valid for the `PATH` they were looked up in
+static void Executor_varChanged(Executor* self, const char* name, size_t name_len) {
+    if (name_len == 4 && memcmp(name, "PATH", 4) == 0) {
+        PathCache_clear(&self->path_cache);
     }
-    return res;
 }
 
-static void Tokenizer_eatWhile(Tokenizer* self, int (*pred)(int)) {
-    while (pred(Tokenizer_peekChar(self))) {
-        self->cur += 1;
-    }
+static size_t rawKeyLen(const char* s) {
+    return (size_t)(strchr(s, '=') - s);
 }
 
-static void Tokenizer_eatWhileNot(Tokenizer* self, char ch) {
-    int c;
-    while ((c = Tokenizer_peekChar(self)) != EOF && c != ch) {
-        self->cur += 1;
-    }
+void Executor_setVarCStrs(Executor* self, const char* name, const char* value, bool replace) {
+    Executor_setVar(self, name, strlen(name), value, strlen(value), replace);
 }
 
-static int isquote(int c) {
-    return c == '"' || c == '\'' || c == '`';
+void Executor_setVar(Executor* self, const char* name, size_t name_len, const char* value,
+                     size_t value_len, bool replace) {
+    Vars_set(&self->vars, name, name_len, value, value_len, replace);
+    Executor_varChanged(self, name, name_len);
 }
 
-static int isargch(int c) {
-    return c != EOF && !isspace(c) && strchr("\"'`$()|&;<>", c) == NULL;
+void Executor_unsetVar(Executor* self, const char* name, size_t name_len) {
+    Vars_unset(&self->vars, name, name_len);
+    Executor_varChanged(self, name, name_len);
 }
 
-static void Tokenizer_readArg(Tokenizer* self, String* lit) {
-    int c;
-    bool escaped = false;
-    for (;;) {
-        c = Tokenizer_peekChar(self);
-        if (c == EOF) {
-            break;
-        }
+bool Executor_exportVar(Executor* self, const char* name, size_t name_len) {
+    return Vars_export(&self->vars, name, name_len);
+}
 
-        if (!escaped && c == '\\') {
-            escaped = true;
-        } else if (!escaped && isargch(c)) {
-            String_append(lit, (char)c);
-            self->cur += 1;
-        } else if (escaped) {
-            String_append(lit, (char)c);
-            self->cur += 1;
-        } else {
+bool Executor_setVarRawMove(Executor* self, char* s, bool replace) {
+    Executor_varChanged(self, s, rawKeyLen(s));
+    return Vars_setRawMove(&self->vars, s, replace);
+}
+
+void Executor_setVarRawCopy(Executor* self, const char* s, bool replace) {
+    Vars_setRawCopy(&self->vars, s, replace);
+    Executor_varChanged(self, s, rawKeyLen(s));
+}
+
+/// Prints a diagnostic about `cmd`, prefixed with its location when running a script. `cmd` can
+/// be `NULL` for commands that are not in the script, e.g. the ones started by `parallel`
+static void Executor_warn(const Executor* self, const Command* cmd, const char* fmt, ...) {
+    if (self->script_path && cmd) {
+        fprintf(stderr, "%s: line %zu: ", self->script_path, cmd->line);
+    }
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+static void Executor_reportResult(const Executor* self, const Command* cmd, ExecutionResult res) {
+    switch (res) {
+        case ExecutionResult_Failure:
+            Executor_warn(self, cmd, "Command not found\n");
             break;
-        }
+        case ExecutionResult_Error:
+            Executor_warn(self, cmd, "Failed to execute command: %s\n", strerror(errno));
+            break;
+        case ExecutionResult_Success:
+        case ExecutionResult_NeedMoreInput:
+        case ExecutionResult_SyntaxError:
+            break;
+    }
+}
+
+typedef enum {
+    ForkExec_Success,
+    ForkExec_FileNotFound,
+    ForkExec_FileNotExecutable,
+    ForkExec_Error,
+} ForkExecResult;
+
+static ForkExecResult spawnErrorToResult(int err) {
+    switch (err) {
+        case ENOENT:
+        case ENOTDIR:
+            return ForkExec_FileNotFound;
+        case EACCES:
+        case ENOEXEC:
+            return ForkExec_FileNotExecutable;
+        default:
+            errno = err;
+            return ForkExec_Error;
     }
 }
 
-static bool Tokenizer_nextTok(Tokenizer* self, String* lit, Token* result, bool* need_more_input) {
-    int c;
-    if ((c = Tokenizer_peekChar(self)) == EOF) {
+static void closePipe(int fds[2]) {
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static bool makePipe(int fds[2]) {
+    if (pipe(fds) == -1) {
+        return false;
+    }
+    // only the `dup2`ed copies should survive `exec`
+    if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) == -1 || fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1) {
+        closePipe(fds);
         return false;
     }
+    return true;
+}
 
-    if (isspace(c)) {
-        Tokenizer_eatWhile(self, isspace);
-        *result = (Token){.kind = TokenKind_Whitespace};
-        *need_more_input = false;
-        return true;
+static int waitChild(pid_t pid, struct rusage* usage) {
+    int st = 0;
+    while (wait4(pid, &st, 0, usage) == -1 && errno == EINTR) {
     }
+    return st;
+}
 
-    if (c == '#') {
-        Tokenizer_eatWhileNot(self, '\n');
-        Tokenizer_eatChar(self);
+#define CAPTURE_CHUNK 65536
+#define CAPTURE_PIPE_SIZE (1 << 20)
 
-        *result = (Token){.kind = TokenKind_Comment};
-        return true;
-    } else if (c == '~') {
-        Tokenizer_eatChar(self);  // eat `~`
-        int next_ch = Tokenizer_peekChar(self);
-        if (next_ch == EOF || isspace(next_ch) || next_ch == '/') {
-            *result = (Token){.kind = TokenKind_Tilda};
-            *need_more_input = false;
-            return true;
-        } else {
-            // otherwise we should fall into `string` case
-            self->cur -= 1;
+/// Reads whatever is available on `fd` straight into the spare capacity of `out`, returns
+/// `false` once `fd` hit EOF
+static bool captureOutput(int fd, String* out) {
+    String_ensureCapacity(out, out->size + CAPTURE_CHUNK);
+    ssize_t len = read(fd, out->items + out->size, out->cap - out->size);
+    if (len == -1) {
+        return errno == EINTR;
+    }
+    out->size += (size_t)len;
+    return len > 0;
+}
+
+/// Sleeps in `poll` until the child writes something or changes state, so no CPU is burnt
+/// while it runs. Returns the wait status of `pid`
+static int supervise(pid_t pid, int out_fd, String* capture, struct rusage* usage) {
+    enum { Out, Child };
+    struct pollfd fds[2] = {
+        [Out] = {.fd = out_fd, .events = POLLIN},
+        [Child] = {.fd = Reaper_fd(), .events = POLLIN},
+    };
+
+    int st = 0;
+    bool exited = false;
+    for (;;) {
+        if (!exited && wait4(pid, &st, WNOHANG, usage) == pid) {
+            exited = true;
+        }
+        if (fds[Out].fd < 0 && exited) {
+            break;
         }
-    } else if (c == '=') {
-        Tokenizer_eatChar(self);  // eat `=`
-        *result = (Token){.kind = TokenKind_EqSign};
-        *need_more_input = false;
-        return true;
-    } else if (c == '$') {
-        Tokenizer_eatChar(self);  // eat `$`
 
-        if (Tokenizer_peekChar(self) == '?') {
-            Tokenizer_eatChar(self);  // eat '?'
-            *result = (Token){.kind = TokenKind_LastExitCodeReq};
-        } else {
-            size_t prev_cur = self->cur;
-            Tokenizer_eatWhile(self, isalnum);
-            size_t len = self->cur - prev_cur;
-            String_appendSlice(lit, self->s + prev_cur, len);
-            *result = (Token){.kind = TokenKind_VariableReference};
+        // once the child is gone only collect what is already buffered: a grandchild may still
+        // hold the pipe open and we must not wait for it
+        int ready = poll(fds, 2, (exited) ? 0 : -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (ready == 0) {
+            break;
         }
-        *need_more_input = false;
-        return true;
-    }
 
-    if (isargch(c) || isquote(c)) {
-        for (;;) {
-            if (isargch(c)) {
-                Tokenizer_readArg(self, lit);
-                *need_more_input = false;
-            } else if (isquote(c)) {
-                size_t prev_cur, len;
-                Tokenizer_eatChar(self);  // eat opening quote
-
-                prev_cur = self->cur;
-                Tokenizer_eatWhileNot(self, (char)c);
-                len = self->cur - prev_cur;
-
-                c = Tokenizer_eatChar(self);  // eat closing quote
-                if (c == EOF) {
-                    *need_more_input = true;
-                } else {
-                    *need_more_input = false;
-                }
-                String_appendSlice(lit, self->s + prev_cur, len);
-            } else {
-                break;
+        if (fds[Out].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!captureOutput(fds[Out].fd, capture)) {
+                fds[Out].fd = -1;
             }
-            c = Tokenizer_peekChar(self);
         }
-        *result = (Token){.kind = TokenKind_String};
-        return true;
-    } else {
-        fprintf(stderr, "`%c` wtf?\n", c);
-        abort();
+        if (fds[Child].revents & POLLIN) {
+            Reaper_drain();
+        }
     }
 
-    assert(0);
-    __builtin_unreachable();
+    if (!exited) {
+        st = waitChild(pid, usage);
+    }
+    return st;
 }
 
-void Executor_init(Executor* self) {
-    Vars_init(&self->vars);
-    self->last_exit_code = 0;
-    self->have_child = false;
-}
+typedef struct {
+    /// descriptor in the child
+    int fd;
+    /// descriptor of the shell it becomes a copy of
+    int src;
+    /// whether `src` was opened for this redirection and has to be closed afterwards
+    bool opened;
+} FdDup;
 
-void Executor_deinit(Executor* self) {
-    Vars_deinit(&self->vars);
+ARENA_ARRAY_LIST_FULL(FdDup, FdDups)
+
+/// How a child is started: `in` and `out` become its stdin and stdout, `-1` means the shell's
+/// own are inherited. Redirections in `dups` are applied after them
+typedef struct {
+    int in;
+    int out;
+    const FdDups* dups;
+    /// background children are put in process group `pgid`, or a new one if it is `0`, so
+    /// that signals from the terminal only reach the foreground
+    bool background;
+    pid_t pgid;
+} ChildSetup;
+
+static void closeRedirections(const FdDups* dups) {
+    for (size_t i = 0; i < dups->size; ++i) {
+        if (dups->items[i].opened) {
+            close(dups->items[i].src);
+        }
+    }
 }
 
-const char* Executor_getVarCStr(Executor* self, const char* name) {
-    return Vars_get(&self->vars, name, strlen(name));
+static void applyChildSetup(ChildSetup setup) {
+    if (setup.background) {
+        setpgid(0, setup.pgid);
+    }
+    if (setup.in != -1) {
+        dup2(setup.in, STDIN_FILENO);
+    }
+    if (setup.out != -1) {
+        dup2(setup.out, STDOUT_FILENO);
+    }
+    for (size_t i = 0; setup.dups && i < setup.dups->size; ++i) {
+        dup2(setup.dups->items[i].src, setup.dups->items[i].fd);
+    }
 }
 
-const char* Executor_getVar(Executor* self, const char* name, size_t len) {
-    return Vars_get(&self->vars, name, len);
+static void Executor_trackChild(Executor* self, pid_t pid) {
+    Pids_append(&self->children, pid);
 }
 
-void Executor_setVarCStrs(Executor* self, const char* name, const char* value, bool replace) {
-    Vars_set(&self->vars, name, strlen(name), value, strlen(value), replace);
+static void Executor_untrackChild(Executor* self, pid_t pid) {
+    for (size_t i = 0; i < self->children.size; ++i) {
+        if (self->children.items[i] == pid) {
+            self->children.items[i] = Pids_pop(&self->children);
+            break;
+        }
+    }
 }
 
-void Executor_setVar(Executor* self, const char* name, size_t name_len, const char* value,
-                     size_t value_len, bool replace) {
-    Vars_set(&self->vars, name, name_len, value, value_len, replace);
+static void addTime(struct timeval* sum, const struct timeval* t) {
+    sum->tv_sec += t->tv_sec;
+    sum->tv_usec += t->tv_usec;
+    if (sum->tv_usec >= 1000000) {
+        sum->tv_sec += 1;
+        sum->tv_usec -= 1000000;
+    }
 }
 
-bool Executor_setVarRawMove(Executor* self, char* s, bool replace) {
-    return Vars_setRawMove(&self->vars, s, replace);
+static void addUsage(struct rusage* sum, const struct rusage* usage) {
+    addTime(&sum->ru_utime, &usage->ru_utime);
+    addTime(&sum->ru_stime, &usage->ru_stime);
+    if (usage->ru_maxrss > sum->ru_maxrss) {
+        sum->ru_maxrss = usage->ru_maxrss;
+    }
 }
 
-void Executor_setVarRawCopy(Executor* self, const char* s, bool replace) {
-    Vars_setRawCopy(&self->vars, s, replace);
+static int Executor_waitChild(Executor* self, pid_t pid, int out_fd, String* capture) {
+    const TraceTime trace_start = Trace_begin();
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    int st = (capture) ? supervise(pid, out_fd, capture, &usage) : waitChild(pid, &usage);
+    addUsage(&self->child_usage, &usage);
+    Executor_untrackChild(self, pid);
+    // with `capture` it is mostly the time spent reading the output
+    Trace_end((capture) ? "wait_capture" : "wait", NULL, trace_start);
+    return st;
 }
 
-static int Executor_cd(Executor* self, size_t argc, char const* const* argv) {
-    if (argc > 1) {
-        fprintf(stderr, "Expected 1 or less arguments, got %zu\n", argc);
-        return 1;
+/// Spawns `args[0]` without probing it first: `posix_spawn` reports `exec` failures of the
+/// child (e.g. `ENOENT` or `EACCES`) back to the parent, which are mapped to `ForkExecResult`.
+/// If `capture_fd` is not `NULL`, the child's stdout is a pipe and its read end is stored there
+static ForkExecResult Executor_startProcess(Executor* self, char* const* args, ChildSetup setup,
+                                            int* capture_fd, pid_t* pid) {
+    int stdout_fds[2] = {-1, -1};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (setup.in != -1) {
+        posix_spawn_file_actions_adddup2(&actions, setup.in, STDIN_FILENO);
+    }
+    if (capture_fd) {
+        if (!makePipe(stdout_fds)) {
+            posix_spawn_file_actions_destroy(&actions);
+            return ForkExec_Error;
+        }
+#ifdef F_SETPIPE_SZ
+        // fewer wakeups for chatty children, failure just leaves the default size
+        fcntl(stdout_fds[1], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+#endif
+        setup.out = stdout_fds[1];
+    }
+    if (setup.out != -1) {
+        posix_spawn_file_actions_adddup2(&actions, setup.out, STDOUT_FILENO);
+    }
+    for (size_t i = 0; setup.dups && i < setup.dups->size; ++i) {
+        const FdDup* dup = &setup.dups->items[i];
+        posix_spawn_file_actions_adddup2(&actions, dup->src, dup->fd);
     }
 
-    const char* path = NULL;
-    if (argc == 0) {
-        path = Executor_getVarCStr(self, "HOME");
-    } else if (argc == 1) {
-        path = argv[0];
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    if (setup.background) {
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, setup.pgid);
     }
 
-    if (chdir(path) == -1) {
-        perror("cd");
-        return 1;
+    int err = posix_spawn(pid, args[0], &actions, &attr, args, Vars_envp(&self->vars));
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (capture_fd) {
+        close(stdout_fds[1]);
     }
-    Executor_setVarCStrs(self, "PWD", path, true);
-    return 0;
-}
 
-typedef enum {
-    ForkExec_Success,
-    ForkExec_FileNotFound,
-    ForkExec_FileNotExecutable,
-    ForkExec_Error,
-} ForkExecResult;
+    if (err != 0) {
+        if (capture_fd) {
+            close(stdout_fds[0]);
+        }
+        return spawnErrorToResult(err);
+    }
 
-static ForkExecResult Executor_forkExec(Executor* self, char* const* args, char* const* env,
-                                        int* exit_code) {
-    struct stat stats;
-    if (stat(args[0], &stats) == -1) {
-        return ForkExec_FileNotFound;
+    if (capture_fd) {
+        *capture_fd = stdout_fds[0];
     }
-    if (!(stats.st_mode & S_IXUSR)) {  // check whether the file is executable
-        return ForkExec_FileNotExecutable;
+    Executor_trackChild(self, *pid);
+    return ForkExec_Success;
+}
+
+static ExecutionResult forkExecToResult(ForkExecResult res) {
+    switch (res) {
+        case ForkExec_Success:
+            return ExecutionResult_Success;
+        case ForkExec_Error:
+            return ExecutionResult_Error;
+        case ForkExec_FileNotFound:
+        case ForkExec_FileNotExecutable:
+            return ExecutionResult_Failure;
     }
 
-    int stdout_fds[2];
-    if (pipe(stdout_fds) == -1) {
-        return ForkExec_Error;
+    assert(0);
+    __builtin_unreachable();
+}
+
+/// Points `args[0]` to the executable it names, returns `false` if there is none
+static bool Executor_resolve(Executor* self, char** args) {
+    if (args[0][0] == '\0') {
+        return false;
+    } else if (args[0][0] == '.' || strchr(args[0], '/') != NULL) {
+        // no resolution is needed
+        return true;
     }
-    int stderr_fds[2];
-    if (pipe(stderr_fds) == -1) {
-        return ForkExec_Error;
+
+    // have to resolve using `PATH`
+    const TraceTime trace_start = Trace_begin();
+    char* exe = PathCache_lookup(&self->path_cache, Executor_getVarCStr(self, "PATH"), args[0]);
+    Trace_end("path_lookup", args[0], trace_start);
+    if (!exe) {
+        return false;
     }
+    args[0] = exe;
+    return true;
+}
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        return ForkExec_Error;
+/// `args[0]` is the same as before when it returns, the resolved path is owned by the cache
+static ExecutionResult Executor_start(Executor* self, char** args, ChildSetup setup,
+                                      int* capture_fd, pid_t* pid) {
+    char* name = args[0];
+    if (!Executor_resolve(self, args)) {
+        return ExecutionResult_Failure;
     }
 
-    if (pid == 0) {
-        close(stdout_fds[0]);
-        close(stderr_fds[0]);
-        dup2(STDOUT_FILENO, stdout_fds[1]);
-        dup2(STDERR_FILENO, stderr_fds[1]);
-        int res = execve(args[0], args, env);
-        if (res == -1) {
-            exit(1);
+    TraceTime trace_start = Trace_begin();
+    ForkExecResult res = Executor_startProcess(self, args, setup, capture_fd, pid);
+    Trace_end("spawn", name, trace_start);
+    if ((res == ForkExec_FileNotFound || res == ForkExec_FileNotExecutable) && args[0] != name) {
+        // the cached executable may have disappeared since it was resolved
+        PathCache_clear(&self->path_cache);
+        args[0] = name;
+        if (!Executor_resolve(self, args)) {
+            return ExecutionResult_Failure;
         }
-    } else {
-        close(stdout_fds[1]);
-        close(stderr_fds[1]);
-        self->have_child = true;
-        self->cur_child = pid;
-        int st;
-        ssize_t len;
-#define BUFSZ 512
-        char buf[BUFSZ];
-        while ((pid = waitpid(self->cur_child, &st, WNOHANG)) == 0) {
-            len = read(stdout_fds[0], buf, BUFSZ);
-            while (len > 0) {
-                len -= write(STDOUT_FILENO, buf, (size_t)len);
-            }
+        trace_start = Trace_begin();
+        res = Executor_startProcess(self, args, setup, capture_fd, pid);
+        Trace_end("spawn", name, trace_start);
+    }
+    args[0] = name;
+    return forkExecToResult(res);
+}
 
-            len = read(stderr_fds[0], buf, BUFSZ);
-            while (len > 0) {
-                len -= write(STDERR_FILENO, buf, (size_t)len);
-            }
-        }
-#undef BUFSZ
-        close(stdout_fds[0]);
-        close(stderr_fds[0]);
-        *exit_code = WEXITSTATUS(st);
-        self->have_child = false;
-        return ForkExec_Success;
+/// Runs an external command to completion. The child inherits the shell's stdout and stderr,
+/// unless `capture` is not `NULL`, in which case its stdout is collected there
+static ExecutionResult Executor_forkExec(Executor* self, char** args, ChildSetup setup,
+                                         String* capture, int* exit_code) {
+    int out_fd = -1;
+    pid_t pid;
+    ExecutionResult res = Executor_start(self, args, setup, (capture) ? &out_fd : NULL, &pid);
+    if (res != ExecutionResult_Success) {
+        return res;
     }
 
-    assert(0);
-    __builtin_unreachable();
+    int st = Executor_waitChild(self, pid, out_fd, capture);
+    if (capture) {
+        close(out_fd);
+    }
+    *exit_code = Reaper_exitCode(st);
+    return ExecutionResult_Success;
 }
 
 void Executor_sendSignalToChild(Executor* self, int sig) {
-    if (self->have_child) {
-        kill(self->cur_child, sig);
+    for (size_t i = 0; i < self->children.size; ++i) {
+        kill(self->children.items[i], sig);
     }
 }
 
-ExecutionResult Executor_execute(Executor* self, const char* cmd, const size_t len) {
-    ExecutionResult res = ExecutionResult_Success;
-
-    Tokenizer tokenizer;
-    Tokenizer_init(&tokenizer, cmd, len);
-
-    String cur_arg, lit;
-    String_init(&cur_arg);
-    String_init(&lit);
-
-    Strings args;
-    Strings_init(&args);
-
-    bool leading_assignments = true;
-    bool parsing_assignment = false;
-    bool null_arg = true;
-    bool need_more_input = false;
-    Token tok;
-
-    Tokenizer_eatWhile(&tokenizer, isspace);
-    while (Tokenizer_nextTok(&tokenizer, &lit, &tok, &need_more_input)) {
-        switch (tok.kind) {
-            case TokenKind_Comment:
-            case TokenKind_Whitespace:
-                if (tok.kind == TokenKind_Comment && null_arg) {
-                    continue;
-                }
-
-                String_append(&cur_arg, '\0');
+static void Executor_substitute(Executor* self, const Program* program, String* capture);
 
-                if (!parsing_assignment) {
-                    leading_assignments = false;
-                    Strings_append(&args, String_toOwnedSlice(&cur_arg));
-                } else {
-                    bool moved = Executor_setVarRawMove(self, String_toOwnedSlice(&cur_arg), true);
-                    assert(moved);
-                }
-                parsing_assignment = false;
-                null_arg = true;
+/// Returns `false` if the word expands to nothing, e.g. it only consists of unset variables
+static bool Executor_expandWord(Executor* self, const Word* word, ArenaString* out) {
+    bool present = false;
+    for (size_t i = 0; i < word->parts.size; ++i) {
+        const WordPart* part = &word->parts.items[i];
+        switch (part->kind) {
+            case WordPart_Literal:
+                present = true;
+                ArenaString_appendSlice(out, part->s, part->len);
                 break;
-            case TokenKind_EqSign:
-                null_arg = false;
-                if (leading_assignments) {
-                    parsing_assignment = true;
-                }
-                String_append(&cur_arg, '=');
-                break;
-            case TokenKind_String:
-                null_arg = false;
-                if (cur_arg.size == 0 && lit.size != 0) {
-                    String_swap(&cur_arg, &lit);
-                } else {
-                    String_appendSlice(&cur_arg, lit.items, lit.size);
+            case WordPart_Variable: {
+                const char* val = Vars_getHashed(&self->vars, part->s, part->len, part->hash);
+                if (val) {
+                    present = true;
+                    ArenaString_appendSlice(out, val, strlen(val));
                 }
                 break;
-            case TokenKind_LastExitCodeReq: {
-                null_arg = false;
+            }
+            case WordPart_LastExitCode: {
+                present = true;
                 char buf[11];
                 size_t len = (size_t)snprintf(buf, sizeof(buf), "%d", self->last_exit_code);
-                String_appendSlice(&cur_arg, buf, len);
+                ArenaString_appendSlice(out, buf, len);
                 break;
             }
-            case TokenKind_Tilda: {
-                null_arg = false;
-                const char* val = Executor_getVarCStr(self, "HOME");
-                String_appendSlice(&cur_arg, val, strlen(val));
+            case WordPart_Command: {
+                String output;
+                String_init(&output);
+                Executor_substitute(self, part->program, &output);
+                // like in other shells, trailing newlines are removed
+                while (output.size > 0 && output.items[output.size - 1] == '\n') {
+                    output.size -= 1;
+                }
+                if (output.size > 0) {
+                    present = true;
+                    ArenaString_appendSlice(out, output.items, output.size);
+                }
+                String_deinit(&output);
                 break;
             }
-            case TokenKind_VariableReference: {
-                const char* val = Executor_getVar(self, lit.items, lit.size);
+            case WordPart_Home: {
+                present = true;
+                const char* val = Executor_getVarCStr(self, "HOME");
                 if (val) {
-                    null_arg = false;
-                    String_appendSlice(&cur_arg, val, strlen(val));
+                    ArenaString_appendSlice(out, val, strlen(val));
                 }
                 break;
             }
         }
-        String_clear(&lit);
     }
+    return present;
+}
 
-    if (!null_arg) {
-        String_append(&cur_arg, '\0');
-        if (!parsing_assignment) {
-            Strings_append(&args, String_toOwnedSlice(&cur_arg));
-        } else {
-            bool moved = Executor_setVarRawMove(self, String_toOwnedSlice(&cur_arg), true);
-            assert(moved);
+/// Applies the assignments of `cmd` and expands its words into `NULL`-terminated `args`
+static void Executor_prepareCommand(Executor* self, const Command* cmd, ArenaStrings* args) {
+    for (size_t i = 0; i < cmd->assignments.size; ++i) {
+        const Assignment* assignment = &cmd->assignments.items[i];
+        ArenaString value;
+        ArenaString_init(&value, &self->arena);
+        Executor_expandWord(self, &assignment->value, &value);
+        Executor_setVar(self, assignment->name, assignment->name_len, value.items, value.size,
+                        true);
+        // there is no temporary environment, so assignments before a command stay set after it
+        if (cmd->words.size > 0) {
+            Executor_exportVar(self, assignment->name, assignment->name_len);
         }
     }
 
-    String_deinit(&cur_arg);
-    String_deinit(&lit);
-
-    if (need_more_input) {
-        res = ExecutionResult_NeedMoreInput;
-        goto cleanup;
+    ArenaStrings_initWithCapacity(args, &self->arena, cmd->words.size + 1);
+    for (size_t i = 0; i < cmd->words.size; ++i) {
+        ArenaString arg;
+        ArenaString_init(&arg, &self->arena);
+        if (Executor_expandWord(self, &cmd->words.items[i], &arg)) {
+            ArenaString_append(&arg, '\0');
+            ArenaStrings_append(args, ArenaString_toOwnedSlice(&arg));
+        }
     }
-    if (args.size == 0) {
-        goto cleanup;
+    ArenaStrings_append(args, NULL);
+}
+
+static bool parseFd(const char* s, int* fd) {
+    if (*s == '\0') {
+        return false;
     }
-    if (strcmp(args.items[0], "cd") == 0) {
-        self->last_exit_code =
-            Executor_cd(self, args.size - 1, (char const* const*)(args.items + 1));
-        goto cleanup;
+    long res = 0;
+    for (; *s; ++s) {
+        if (!isdigit((unsigned char)*s) || res > 9999) {
+            return false;
+        }
+        res = res * 10 + (*s - '0');
     }
+    *fd = (int)res;
+    return true;
+}
 
-    Strings_append(&args, NULL);
-    char* exe = args.items[0];
-    size_t exe_len = strlen(exe);
-    if (exe_len == 0) {
-        res = ExecutionResult_Failure;
-    } else if (exe[0] == '.' || strchr(exe, '/') != NULL) {
-        // no resolution is needed
-        switch (Executor_forkExec(self, args.items, self->vars.items, &self->last_exit_code)) {
-            case ForkExec_Success:
+/// Files are opened by the shell with `O_CLOEXEC`, so only their `dup2`ed copies reach the child
+/// and errors can be reported precisely. On failure everything is closed again
+static bool Executor_openRedirections(Executor* self, const Command* cmd, FdDups* dups) {
+    FdDups_initWithCapacity(dups, &self->arena, cmd->redirections.size);
+    for (size_t i = 0; i < cmd->redirections.size; ++i) {
+        const Redirection* redirection = &cmd->redirections.items[i];
+        ArenaString target;
+        ArenaString_init(&target, &self->arena);
+        bool present = Executor_expandWord(self, &redirection->target, &target);
+        ArenaString_append(&target, '\0');
+        if (!present) {
+            Executor_warn(self, cmd, "ambiguous redirect\n");
+            closeRedirections(dups);
+            return false;
+        }
+
+        FdDup dup = {.fd = redirection->fd, .opened = redirection->kind != Redirection_Dup};
+        int flags = O_CLOEXEC;
+        switch (redirection->kind) {
+            case Redirection_Input:
+                flags |= O_RDONLY;
                 break;
-            case ForkExec_Error:
-                res = ExecutionResult_Error;
+            case Redirection_Output:
+                flags |= O_WRONLY | O_CREAT | O_TRUNC;
                 break;
-            case ForkExec_FileNotFound:
-            case ForkExec_FileNotExecutable:
-                res = ExecutionResult_Failure;
+            case Redirection_Append:
+                flags |= O_WRONLY | O_CREAT | O_APPEND;
                 break;
-        }
-    } else {
-        // have to resolve using `PATH`
-        const char* path = Executor_getVarCStr(self, "PATH");
-        String buf;
-        String_init(&buf);
-        for (;;) {
-            const char* colon = strchr(path, ':');
-            const size_t segment_len = (colon) ? (size_t)(colon - path) : strlen(path);
-            if (segment_len == 0) {
-                if (!colon) {
-                    res = ExecutionResult_Failure;
-                    break;
-                } else {
-                    path = colon + 1;
-                    continue;
+            case Redirection_Dup:
+                if (!parseFd(target.items, &dup.src)) {
+                    Executor_warn(self, cmd, "%s: bad file descriptor\n", target.items);
+                    closeRedirections(dups);
+                    return false;
                 }
+                break;
+        }
+        if (dup.opened && (dup.src = open(target.items, flags, 0666)) == -1) {
+            Executor_warn(self, cmd, "%s: %s\n", target.items, strerror(errno));
+            closeRedirections(dups);
+            return false;
+        }
+        FdDups_append(dups, dup);
+    }
+    return true;
+}
+
+/// Applies `dups` to the shell itself for running a builtin, what they replaced is kept in
+/// `saved` for `restoreRedirections`
+static void Executor_applyRedirections(Executor* self, const FdDups* dups, FdDups* saved) {
+    FdDups_initWithCapacity(saved, &self->arena, dups->size);
+    fflush(NULL);
+    for (size_t i = 0; i < dups->size; ++i) {
+        // `-1` means the descriptor was not open
+        const int fd = dups->items[i].fd;
+        FdDups_append(saved, (FdDup){.fd = fd, .src = fcntl(fd, F_DUPFD_CLOEXEC, 10)});
+        dup2(dups->items[i].src, fd);
+    }
+}
+
+static void restoreRedirections(const FdDups* saved) {
+    fflush(NULL);
+    for (size_t i = saved->size; i > 0; --i) {
+        const FdDup* dup = &saved->items[i - 1];
+        if (dup->src == -1) {
+            close(dup->fd);
+        } else {
+            dup2(dup->src, dup->fd);
+            close(dup->src);
+        }
+    }
+}
+
+static int exitCodeFromResult(ExecutionResult res) {
+    return (res == ExecutionResult_Failure) ? 127 : 126;
+}
+
+/// `args` is `NULL`-terminated, `cmd` is only used for reporting failures and can be `NULL`
+static pid_t Executor_startStageProcess(Executor* self, const Command* cmd, char** args,
+                                        size_t argc, ChildSetup setup, int* exit_code) {
+    if (argc == 0) {
+        *exit_code = 0;
+        return -1;
+    }
+
+    pid_t pid;
+    const BuiltinEntry* builtin = Builtin_find(args[0]);
+    if (builtin) {
+        // builtins in a pipeline run in a subshell, like they do in other shells
+        fflush(NULL);
+        pid = fork();
+        if (pid == 0) {
+            if (!Reaper_reinstall()) {
+                Executor_reportResult(self, cmd, ExecutionResult_Error);
+                _exit(exitCodeFromResult(ExecutionResult_Error));
             }
+            applyChildSetup(setup);
+            int code = builtin->run(self, argc - 1, (char const* const*)(args + 1));
+            fflush(NULL);
+            _exit(code);
+        }
+        if (pid != -1) {
+            if (setup.background) {
+                // the child does the same, so the group exists whichever of them runs first
+                setpgid(pid, (setup.pgid == 0) ? pid : setup.pgid);
+            }
+            Executor_trackChild(self, pid);
+            return pid;
+        }
+        Executor_reportResult(self, cmd, ExecutionResult_Error);
+        *exit_code = exitCodeFromResult(ExecutionResult_Error);
+        return -1;
+    }
+
+    ExecutionResult res = Executor_start(self, args, setup, NULL, &pid);
+    if (res != ExecutionResult_Success) {
+        Executor_reportResult(self, cmd, res);
+        *exit_code = exitCodeFromResult(res);
+        return -1;
+    }
+    return pid;
+}
+
+/// Starts one stage of a pipeline without waiting for it. Returns `-1` if no process was
+/// started, in which case the stage's exit code is stored in `exit_code`
+static pid_t Executor_startStage(Executor* self, const Command* cmd, ChildSetup setup,
+                                 int* exit_code) {
+    ArenaStrings args;
+    Executor_prepareCommand(self, cmd, &args);
+
+    FdDups dups;
+    if (!Executor_openRedirections(self, cmd, &dups)) {
+        *exit_code = 1;
+        return -1;
+    }
+    setup.dups = &dups;
+
+    pid_t pid =
+        Executor_startStageProcess(self, cmd, args.items, args.size - 1, setup, exit_code);
+    closeRedirections(&dups);
+    return pid;
+}
+
+/// A pipe could fill up while a builtin writes to it, as nothing reads it until the builtin
+/// returns, so builtins in substitutions write to a file. It is reused for each nesting level
+static int Executor_captureFile(Executor* self) {
+    assert(self->capture_depth > 0);
+    const size_t level = self->capture_depth - 1;
+    while (self->capture_fds.size <= level) {
+        char path[] = "/tmp/blush-capture-XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1) {
+            return -1;
+        }
+        unlink(path);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        Fds_append(&self->capture_fds, fd);
+    }
+
+    const int fd = self->capture_fds.items[level];
+    if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+        return -1;
+    }
+    return fd;
+}
+
+static void readCaptureFile(int fd, String* capture) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        return;
+    }
+    const size_t size = (size_t)st.st_size;
+    String_ensureCapacity(capture, capture->size + size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, capture->items + capture->size + done, size - done, (off_t)done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    capture->size += done;
+}
+
+/// Runs `builtin` in the shell with its stdout going to `capture` if it is not `NULL`
+static ExecutionResult Executor_runBuiltin(Executor* self, const BuiltinEntry* builtin,
+                                           const ArenaStrings* args, const FdDups* dups,
+                                           String* capture) {
+    FdDups all = *dups;
+    int capture_fd = -1;
+    if (capture) {
+        if ((capture_fd = Executor_captureFile(self)) == -1) {
+            return ExecutionResult_Error;
+        }
+        // the command's own redirections still apply, e.g. `>&2`
+        FdDups_initWithCapacity(&all, &self->arena, dups->size + 1);
+        FdDups_append(&all, (FdDup){.fd = STDOUT_FILENO, .src = capture_fd});
+        FdDups_appendSlice(&all, dups->items, dups->size);
+    }
+
+    FdDups saved;
+    Executor_applyRedirections(self, &all, &saved);
+    const size_t argc = args->size - 1;
+    self->last_exit_code = builtin->run(self, argc - 1, (char const* const*)(args->items + 1));
+    restoreRedirections(&saved);
+    if (capture) {
+        readCaptureFile(capture_fd, capture);
+    }
+    return ExecutionResult_Success;
+}
+
+/// Runs a single command. With `capture` its stdout is collected there, and builtins that would
+/// change the shell run in a subshell
+static ExecutionResult Executor_runCommand(Executor* self, const Command* cmd, String* capture) {
+    self->substituted = false;
+    ArenaStrings args;
+    Executor_prepareCommand(self, cmd, &args);
+    const size_t argc = args.size - 1;
 
-            // construct the path
-            String_clear(&buf);
-            String_appendSlice(&buf, path, segment_len);
-            if (buf.items[buf.size - 1] != '/') {
-                String_append(&buf, '/');
+    FdDups dups;
+    if (!Executor_openRedirections(self, cmd, &dups)) {
+        self->last_exit_code = 1;
+        return ExecutionResult_Success;
+    }
+
+    ExecutionResult res = ExecutionResult_Success;
+    const BuiltinEntry* builtin = (argc > 0) ? Builtin_find(args.items[0]) : NULL;
+    if (argc == 0) {
+        if (!self->substituted) {
+            self->last_exit_code = 0;
+        }
+    } else if (builtin && (!capture || builtin->pure)) {
+        res = Executor_runBuiltin(self, builtin, &args, &dups, capture);
+    } else if (builtin) {
+        int fds[2];
+        if (makePipe(fds)) {
+            const ChildSetup setup = {.in = -1, .out = fds[1], .dups = &dups};
+            int code = 0;
+            pid_t pid = Executor_startStageProcess(self, cmd, args.items, argc, setup, &code);
+            close(fds[1]);
+            if (pid != -1) {
+                code = Reaper_exitCode(Executor_waitChild(self, pid, fds[0], capture));
             }
-            String_appendSlice(&buf, exe, exe_len);
-            String_append(&buf, '\0');
-
-            // try to execute it
-            args.items[0] = buf.items;
-            ForkExecResult feres =
-                Executor_forkExec(self, args.items, self->vars.items, &self->last_exit_code);
-            if (feres == ForkExec_Success) {
-                break;
-            } else if (feres == ForkExec_Error) {
-                res = ExecutionResult_Error;
-            } else if ((feres == ForkExec_FileNotExecutable || feres == ForkExec_FileNotFound) &&
-                       !colon) {
-                res = ExecutionResult_Failure;
-                break;
-            } else {
-                path = colon + 1;
+            close(fds[0]);
+            self->last_exit_code = code;
+        } else {
+            res = ExecutionResult_Error;
+        }
+    } else {
+        const ChildSetup setup = {.in = -1, .out = -1, .dups = &dups};
+        res = Executor_forkExec(self, args.items, setup, capture, &self->last_exit_code);
+    }
+    if (res != ExecutionResult_Success) {
+        // 127 if the command was not found, 126 if it could not be run
+        self->last_exit_code = exitCodeFromResult(res);
+    }
+    closeRedirections(&dups);
+    return res;
+}
+
+/// Runs a pipeline of one command, which is not forked for builtins
+static ExecutionResult Executor_runSingle(Executor* self, const Command* cmd, String* capture) {
+    ExecutionResult res = Executor_runCommand(self, cmd, capture);
+    Executor_reportResult(self, cmd, res);
+    return res;
+}
+
+/// Everything but a single command runs in a forked subshell
+static void Executor_captureSubshell(Executor* self, const Program* program, String* capture) {
+    int fds[2];
+    if (!makePipe(fds)) {
+        Executor_reportResult(self, NULL, ExecutionResult_Error);
+        self->last_exit_code = exitCodeFromResult(ExecutionResult_Error);
+        return;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!Reaper_reinstall()) {
+            Executor_reportResult(self, NULL, ExecutionResult_Error);
+            _exit(exitCodeFromResult(ExecutionResult_Error));
+        }
+        dup2(fds[1], STDOUT_FILENO);
+        closePipe(fds);
+        Executor_executeProgram(self, program);
+        fflush(NULL);
+        _exit(self->last_exit_code);
+    }
+    close(fds[1]);
+    if (pid == -1) {
+        Executor_reportResult(self, NULL, ExecutionResult_Error);
+        self->last_exit_code = exitCodeFromResult(ExecutionResult_Error);
+    } else {
+        Pids_ensureCapacity(&self->children, self->children.size + 1);
+        Executor_trackChild(self, pid);
+        self->last_exit_code = Reaper_exitCode(Executor_waitChild(self, pid, fds[0], capture));
+    }
+    close(fds[0]);
+}
+
+/// Like in other shells the substitution must not change the state of the shell. A single
+/// command needs no subshell for that: an external one is spawned directly and builtins without
+/// side effects run in the shell itself, so e.g. `$(pwd)` costs no process at all
+static void Executor_substitute(Executor* self, const Program* program, String* capture) {
+    self->capture_depth += 1;
+    const Pipelines* pipelines = &program->pipelines;
+    if (pipelines->size == 1 && !pipelines->items[0].background &&
+        pipelines->items[0].commands.size == 1 &&
+        pipelines->items[0].commands.items[0].assignments.size == 0) {
+        Executor_runSingle(self, &pipelines->items[0].commands.items[0], capture);
+    } else if (pipelines->size > 0) {
+        Executor_captureSubshell(self, program, capture);
+    }
+    self->capture_depth -= 1;
+    self->substituted = true;
+}
+
+pid_t Executor_startCommand(Executor* self, char** args, size_t argc, int* out_fd,
+                            int* exit_code) {
+    int fds[2];
+    if (!makePipe(fds)) {
+        Executor_reportResult(self, NULL, ExecutionResult_Error);
+        *exit_code = exitCodeFromResult(ExecutionResult_Error);
+        return -1;
+    }
+
+    Pids_ensureCapacity(&self->children, self->children.size + 1);
+    const ChildSetup setup = {.in = -1, .out = fds[1]};
+    pid_t pid = Executor_startStageProcess(self, NULL, args, argc, setup, exit_code);
+    close(fds[1]);
+    if (pid == -1) {
+        close(fds[0]);
+    } else {
+        *out_fd = fds[0];
+    }
+    return pid;
+}
+
+int Executor_runArgs(Executor* self, char** args, size_t argc) {
+    if (argc == 0) {
+        return 0;
+    }
+    const BuiltinEntry* builtin = Builtin_find(args[0]);
+    if (builtin) {
+        return builtin->run(self, argc - 1, (char const* const*)(args + 1));
+    }
+
+    int code = 0;
+    const ChildSetup setup = {.in = -1, .out = -1};
+    Pids_ensureCapacity(&self->children, self->children.size + 1);
+    const ExecutionResult res = Executor_forkExec(self, args, setup, NULL, &code);
+    if (res != ExecutionResult_Success) {
+        Executor_reportResult(self, NULL, res);
+        code = exitCodeFromResult(res);
+    }
+    return code;
+}
+
+static double timespecSeconds(const struct timespec* t) {
+    return (double)t->tv_sec + (double)t->tv_nsec / 1e9;
+}
+
+static double timevalSeconds(const struct timeval* t) {
+    return (double)t->tv_sec + (double)t->tv_usec / 1e6;
+}
+
+void Executor_startUsage(Executor* self, UsageStart* start) {
+    clock_gettime(CLOCK_MONOTONIC, &start->real);
+    getrusage(RUSAGE_SELF, &start->shell);
+    // the children of this measurement are counted from zero and added back in the end
+    start->children = self->child_usage;
+    memset(&self->child_usage, 0, sizeof(self->child_usage));
+}
+
+Usage Executor_finishUsage(Executor* self, const UsageStart* start) {
+    struct timespec real;
+    clock_gettime(CLOCK_MONOTONIC, &real);
+    struct rusage shell;
+    getrusage(RUSAGE_SELF, &shell);
+
+    const struct rusage* children = &self->child_usage;
+    const Usage usage = {
+        .real = timespecSeconds(&real) - timespecSeconds(&start->real),
+        .user = timevalSeconds(&shell.ru_utime) - timevalSeconds(&start->shell.ru_utime) +
+                timevalSeconds(&children->ru_utime),
+        .sys = timevalSeconds(&shell.ru_stime) - timevalSeconds(&start->shell.ru_stime) +
+               timevalSeconds(&children->ru_stime),
+        .max_rss = children->ru_maxrss,
+    };
+
+    struct rusage outer = start->children;
+    addUsage(&outer, children);
+    self->child_usage = outer;
+    return usage;
+}
+
+static void printSeconds(FILE* f, const char* name, double seconds) {
+    const int minutes = (int)(seconds / 60);
+    fprintf(f, "%s\t%dm%.3fs\n", name, minutes, seconds - minutes * 60.0);
+}
+
+void Usage_print(const Usage* usage, FILE* f) {
+    fprintf(f, "\n");
+    printSeconds(f, "real", usage->real);
+    printSeconds(f, "user", usage->user);
+    printSeconds(f, "sys", usage->sys);
+    if (usage->max_rss > 0) {
+        fprintf(f, "maxrss\t%ldK\n", usage->max_rss);
+    }
+}
+
+bool Executor_tryWaitChild(Executor* self, pid_t pid, int* exit_code) {
+    int st;
+    struct rusage usage;
+    if (wait4(pid, &st, WNOHANG, &usage) != pid) {
+        return false;
+    }
+    addUsage(&self->child_usage, &usage);
+    Executor_untrackChild(self, pid);
+    *exit_code = Reaper_exitCode(st);
+    return true;
+}
+
+/// Starts every stage connected directly with pipes, `setup` applies to the whole pipeline and
+/// its `in` is closed once the first stage has it. Returns how many stages were started, which
+/// is less than all of them only if creating a pipe failed
+static size_t Executor_startPipeline(Executor* self, const Pipeline* pipeline, ChildSetup setup,
+                                     pid_t* pids, int* codes) {
+    const size_t n = pipeline->commands.size;
+    // so that the signal handler never sees the list being reallocated
+    Pids_ensureCapacity(&self->children, self->children.size + n);
+
+    int in_fd = setup.in;
+    size_t started = 0;
+    for (; started < n; ++started) {
+        int fds[2] = {-1, -1};
+        if (started + 1 < n && !makePipe(fds)) {
+            Executor_reportResult(self, &pipeline->commands.items[started],
+                                  ExecutionResult_Error);
+            break;
+        }
+
+        setup.in = in_fd;
+        setup.out = fds[1];
+        pids[started] = Executor_startStage(self, &pipeline->commands.items[started], setup,
+                                            &codes[started]);
+        if (setup.background && setup.pgid == 0 && pids[started] != -1) {
+            setup.pgid = pids[started];
+        }
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        if (fds[1] != -1) {
+            close(fds[1]);
+        }
+        in_fd = fds[0];
+    }
+    if (in_fd != -1) {
+        close(in_fd);
+    }
+    return started;
+}
+
+/// Every stage is started before any is waited for, so they all run concurrently
+static ExecutionResult Executor_runPipeline(Executor* self, const Pipeline* pipeline) {
+    const size_t n = pipeline->commands.size;
+    assert(n > 1);
+
+    pid_t* pids = Arena_alloc(&self->arena, n * sizeof(pid_t));
+    int* codes = Arena_alloc(&self->arena, n * sizeof(int));
+    const ChildSetup setup = {.in = -1, .out = -1};
+    const size_t started = Executor_startPipeline(self, pipeline, setup, pids, codes);
+
+    int failed_code = 0;
+    for (size_t i = 0; i < started; ++i) {
+        if (pids[i] != -1) {
+            codes[i] = Reaper_exitCode(Executor_waitChild(self, pids[i], -1, NULL));
+        }
+        if (codes[i] != 0) {
+            failed_code = codes[i];
+        }
+    }
+
+    if (started < n) {
+        return ExecutionResult_Error;
+    }
+    self->last_exit_code = (self->pipefail && failed_code != 0) ? failed_code : codes[n - 1];
+    return ExecutionResult_Success;
+}
+
+/// Without job control, other shells give background jobs `/dev/null` as their stdin, which
+/// also keeps them from stopping on terminal reads in their own process group
+static ExecutionResult Executor_startJob(Executor* self, const Pipeline* pipeline) {
+    const size_t n = pipeline->commands.size;
+    pid_t* pids = Arena_alloc(&self->arena, n * sizeof(pid_t));
+    int* codes = Arena_alloc(&self->arena, n * sizeof(int));
+    const int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null_fd == -1) {
+        Executor_reportResult(self, &pipeline->commands.items[0], ExecutionResult_Error);
+        self->last_exit_code = exitCodeFromResult(ExecutionResult_Error);
+        return ExecutionResult_Error;
+    }
+    const ChildSetup setup = {
+        .in = null_fd,
+        .out = -1,
+        .background = true,
+        .pgid = 0,
+    };
+
+    const size_t tracked = self->children.size;
+    const size_t started = Executor_startPipeline(self, pipeline, setup, pids, codes);
+    // signals the shell receives are only forwarded to the foreground
+    self->children.size = tracked;
+
+    if (started < n) {
+        for (size_t i = 0; i < started; ++i) {
+            if (pids[i] != -1) {
+                kill(pids[i], SIGTERM);
+                Executor_waitChild(self, pids[i], -1, NULL);
             }
         }
-        String_deinit(&buf);
-        args.items[0] = exe;  // for nice freeing
+        return ExecutionResult_Error;
+    }
+    JobTable_add(&self->jobs, pids, codes, n, pipeline->text, pipeline->text_len,
+                 self->pipefail);
+    self->last_exit_code = 0;
+    return ExecutionResult_Success;
+}
+
+ExecutionResult Executor_executePipeline(Executor* self, const Pipeline* pipeline) {
+    // finished background jobs don't linger as zombies while a script runs
+    JobTable_reap(&self->jobs, self->pipefail);
+
+    const TraceTime trace_start = Trace_begin();
+    UsageStart usage_start;
+    const bool timed = pipeline->timed && !pipeline->background;
+    if (timed) {
+        Executor_startUsage(self, &usage_start);
+    }
+    ExecutionResult res;
+    if (pipeline->background) {
+        res = Executor_startJob(self, pipeline);
+    } else if (pipeline->commands.size == 1) {
+        res = Executor_runSingle(self, &pipeline->commands.items[0], NULL);
+    } else {
+        res = Executor_runPipeline(self, pipeline);
+    }
+    if (timed) {
+        const Usage usage = Executor_finishUsage(self, &usage_start);
+        fflush(stdout);
+        Usage_print(&usage, stderr);
+    }
+
+    // everything built for this pipeline lives in the arena
+    Arena_reset(&self->arena);
+    Trace_endSlice("pipeline", pipeline->text, pipeline->text_len, trace_start);
+    return res;
+}
+
+static ExecutionResult Executor_runPipelines(Executor* self, const Pipeline* pipelines, size_t n,
+                                            bool in_job);
+
+/// Runs the `n` pipelines of an and/or list ended with `&` as one job, a forked shell evaluates
+/// the `&&` and `||` between them
+static ExecutionResult Executor_startListJob(Executor* self, const Pipeline* pipelines, size_t n) {
+    JobTable_reap(&self->jobs, self->pipefail);
+    const Command* first = &pipelines[0].commands.items[0];
+    // like the stages of a single pipeline started with `&`
+    const int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null_fd == -1) {
+        Executor_reportResult(self, first, ExecutionResult_Error);
+        self->last_exit_code = exitCodeFromResult(ExecutionResult_Error);
+        return ExecutionResult_Error;
+    }
+
+    fflush(NULL);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        if (!Reaper_reinstall()) {
+            Executor_reportResult(self, first, ExecutionResult_Error);
+            _exit(exitCodeFromResult(ExecutionResult_Error));
+        }
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+        Executor_runPipelines(self, pipelines, n, true);
+        fflush(NULL);
+        _exit(self->last_exit_code);
+    }
+    close(null_fd);
+    if (pid == -1) {
+        Executor_reportResult(self, first, ExecutionResult_Error);
+        self->last_exit_code = exitCodeFromResult(ExecutionResult_Error);
+        return ExecutionResult_Error;
     }
+    // the child does the same, so the group exists whichever of them runs first
+    setpgid(pid, pid);
 
-cleanup:
-    for (size_t i = 0; i < args.size; ++i) {
-        if (args.items[i] != NULL) {
-            free(args.items[i]);
+    ArenaString text;
+    ArenaString_init(&text, &self->arena);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            const char* op =
+                (pipelines[i].condition == PipelineCondition_IfSucceeded) ? " && " : " || ";
+            ArenaString_appendSlice(&text, op, strlen(op));
         }
+        ArenaString_appendSlice(&text, pipelines[i].text, pipelines[i].text_len);
     }
-    Strings_deinit(&args);
+    const int code = 0;
+    JobTable_add(&self->jobs, &pid, &code, 1, text.items, text.size, self->pipefail);
+    Arena_reset(&self->arena);
+    self->last_exit_code = 0;
+    return ExecutionResult_Success;
+}
+
+/// With `in_job` the pipelines run in a job's forked shell, which waits for all of them
+static ExecutionResult Executor_runPipelines(Executor* self, const Pipeline* pipelines, size_t n,
+                                            bool in_job) {
+    ExecutionResult res = ExecutionResult_Success;
+    bool succeeded = true;
+    size_t i = 0;
+    while (i < n) {
+        const Pipeline* pipeline = &pipelines[i];
+        // a list ended with `&` starts with an unconditional pipeline and runs as a whole
+        size_t list_size = 1;
+        while (pipeline->background && !in_job && i + list_size < n &&
+               pipelines[i + list_size].condition != PipelineCondition_Always) {
+            list_size += 1;
+        }
 
+        // a skipped pipeline leaves the exit code for the next condition as it is
+        if ((pipeline->condition == PipelineCondition_IfSucceeded && !succeeded) ||
+            (pipeline->condition == PipelineCondition_IfFailed && succeeded)) {
+            i += 1;
+            continue;
+        }
+        if (list_size > 1) {
+            res = Executor_startListJob(self, pipeline, list_size);
+        } else if (in_job && pipeline->background) {
+            Pipeline foreground = *pipeline;
+            foreground.background = false;
+            res = Executor_executePipeline(self, &foreground);
+        } else {
+            res = Executor_executePipeline(self, pipeline);
+        }
+        succeeded = res == ExecutionResult_Success && self->last_exit_code == 0;
+        i += list_size;
+    }
     return res;
 }
+
+ExecutionResult Executor_executeProgram(Executor* self, const Program* program) {
+    return Executor_runPipelines(self, program->pipelines.items, program->pipelines.size, false);
+}
+
+void Executor_notifyJobs(Executor* self) {
+    JobTable_reap(&self->jobs, self->pipefail);
+    JobTable_print(&self->jobs, stderr, true);
+}
+
+void Executor_reportParseError(const Executor* self, const ParseError* error) {
+    if (self->script_path) {
+        fprintf(stderr, "%s: line %zu: ", self->script_path, error->line);
+    }
+    fprintf(stderr, "syntax error near unexpected token `%.*s`\n", (int)error->token_len,
+            error->token);
+}
+
+ExecutionResult Executor_execute(Executor* self, const char* cmd, const size_t len) {
+    if (self->parser == NULL) {
+        self->parser = Parser_create(&self->program_arena, &self->program);
+    }
+    // the program refers to the input, so it is kept with the program
+    char* src = Arena_alloc(&self->program_arena, len + 1);
+    memcpy(src, cmd, len);
+
+    ParseError error;
+    const TraceTime trace_start = Trace_begin();
+    const ParseResult parsed = Parser_feed(self->parser, src, len, &error);
+    Trace_end("parse", NULL, trace_start);
+    switch (parsed) {
+        case ParseResult_Success: {
+            const ExecutionResult res = Executor_executeProgram(self, &self->program);
+            Executor_discardInput(self);
+            return res;
+        }
+        case ParseResult_NeedMoreInput:
+            return ExecutionResult_NeedMoreInput;
+        case ParseResult_SyntaxError:
+            Executor_reportParseError(self, &error);
+            self->last_exit_code = 2;
+            Executor_discardInput(self);
+            return ExecutionResult_SyntaxError;
+    }
+
+    assert(0);
+    __builtin_unreachable();
+}
+
+void Executor_discardInput(Executor* self) {
+    self->parser = NULL;
+    Arena_reset(&self->program_arena);
+}
@@ -2,15 +2,47 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <time.h>
 
+#include "alloc.h"
+#include "jobs.h"
+#include "parser.h"
+#include "path_cache.h"
 #include "vars.h"
 
+ARRAY_LIST_STRUCT(pid_t, Pids)
+ARRAY_LIST_STRUCT(int, Fds)
+
 typedef struct {
     Vars vars;
-    pid_t cur_child;
-    bool have_child;
+    PathCache path_cache;
+    /// per-command temporaries, reset after every command
+    Arena arena;
+    /// holds what `Executor_execute` parsed until it is done running it
+    Arena program_arena;
+    /// the command `Executor_execute` got only a part of so far, `NULL` if there is none
+    Parser* parser;
+    Program program;
+    /// when set, failures are reported with the script path and line
+    const char* script_path;
+    /// children the shell is currently waiting for, signals it receives are forwarded to them
+    Pids children;
+    /// pipelines started with `&`
+    JobTable jobs;
+    /// files builtins in command substitutions write to, one per nesting level
+    Fds capture_fds;
+    size_t capture_depth;
+    /// whether expanding the current command ran a substitution, whose exit code is then kept
+    /// if the command consists only of assignments
+    bool substituted;
+    /// whether a pipeline fails if any of its stages does, not just the last one
+    bool pipefail;
     int last_exit_code;
+    /// summed up over the foreground children waited for, `ru_maxrss` is the largest of theirs
+    struct rusage child_usage;
 } Executor;
 
 void Executor_init(Executor* self);
@@ -21,16 +53,73 @@ typedef enum {
     ExecutionResult_Failure,
     ExecutionResult_Error,
     ExecutionResult_NeedMoreInput,
+    ExecutionResult_SyntaxError,
 } ExecutionResult;
+
+/// Parses all of `cmd` and then runs it. Failures of the commands and syntax errors are reported
+/// by the executor itself. After `ExecutionResult_NeedMoreInput` the next call continues the
+/// command with more input, `cmd` is copied so the caller can reuse its buffer
 ExecutionResult Executor_execute(Executor* self, const char* cmd, size_t len);
+
+/// Forgets the incomplete command `Executor_execute` got so far
+void Executor_discardInput(Executor* self);
+
+/// Runs every command of an already parsed program, returns the result of the last one
+ExecutionResult Executor_executeProgram(Executor* self, const Program* program);
+ExecutionResult Executor_executePipeline(Executor* self, const Pipeline* pipeline);
+void Executor_reportParseError(const Executor* self, const ParseError* error);
 void Executor_sendSignalToChild(Executor* self, int sig);
 
+/// Starts the `NULL`-terminated `args` with `argc` elements without waiting for it, its stdout
+/// is a new pipe with the read end stored in `out_fd`. Builtins run in a forked shell. Returns
+/// `-1` if nothing was started, the failure is reported then and `exit_code` holds the exit code
+pid_t Executor_startCommand(Executor* self, char** args, size_t argc, int* out_fd,
+                            int* exit_code);
+
+/// Collects `pid` if it has exited, without blocking. Returns `false` if it is still running
+bool Executor_tryWaitChild(Executor* self, pid_t pid, int* exit_code);
+
+/// Reports the background jobs that finished since the last call, for interactive use
+void Executor_notifyJobs(Executor* self);
+
 const char* Executor_getVarCStr(Executor* self, const char* name);
+
+/// Runs the `NULL`-terminated `args` with `argc` elements in the foreground like a simple command,
+/// a builtin in the shell itself. Returns the exit code
+int Executor_runArgs(Executor* self, char** args, size_t argc);
+
+typedef struct {
+    struct timespec real;
+    struct rusage shell;
+    struct rusage children;
+} UsageStart;
+
+/// What commands used, times are in seconds
+typedef struct {
+    double real;
+    double user;
+    double sys;
+    /// in KiB, of the largest child, `0` if no child was waited for
+    long max_rss;
+} Usage;
+
+/// Measures what the commands run until `Executor_finishUsage` use, the shell itself included.
+/// Measurements can be nested
+void Executor_startUsage(Executor* self, UsageStart* start);
+Usage Executor_finishUsage(Executor* self, const UsageStart* start);
+
+/// Prints `usage` like `time` does
+void Usage_print(const Usage* usage, FILE* f);
 const char* Executor_getVar(Executor* self, const char* name, size_t len);
 void Executor_setVarCStrs(Executor* self, const char* name, const char* value, bool replace);
 void Executor_setVar(Executor* self, const char* name, size_t name_len, const char* value,
                      size_t value_len, bool replace);
 
+void Executor_unsetVar(Executor* self, const char* name, size_t name_len);
+
+/// Returns `false` if the variable is not set
+bool Executor_exportVar(Executor* self, const char* name, size_t name_len);
+
 /// Returns `true` if `s` was inserted
 bool Executor_setVarRawMove(Executor* self, char* s, bool replace);
 
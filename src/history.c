@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+
+#include "history.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ARRAY_LIST_SIGNATURES(HistorySpan, HistorySpans)
+ARRAY_LIST_IMPL(HistorySpan, HistorySpans)
+
+void History_init(History* self, const char* path) {
+    assert(self);
+    *self = (History){
+        .fd = -1,
+        .mapped = NULL,
+        .mapped_len = 0,
+        .unscanned = 0,
+    };
+    HistorySpans_init(&self->file_lines);
+    String_init(&self->added);
+    HistorySpans_init(&self->added_lines);
+    if (path == NULL) {
+        return;
+    }
+
+    self->fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    struct stat st;
+    if (self->fd == -1 || fstat(self->fd, &st) == -1 || st.st_size == 0) {
+        return;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, self->fd, 0);
+    if (data == MAP_FAILED) {
+        return;
+    }
+    self->mapped = data;
+    self->mapped_len = (size_t)st.st_size;
+    self->unscanned = self->mapped_len;
+
+    // a line cut short, e.g. by a crash, would otherwise run into the next one added
+    if (self->mapped[self->mapped_len - 1] != '\n' && write(self->fd, "\n", 1) == -1) {
+        close(self->fd);
+        self->fd = -1;
+    }
+}
+
+void History_deinit(History* self) {
+    if (self->mapped != NULL) {
+        munmap(self->mapped, self->mapped_len);
+    }
+    if (self->fd != -1) {
+        close(self->fd);
+    }
+    HistorySpans_deinit(&self->file_lines);
+    String_deinit(&self->added);
+    HistorySpans_deinit(&self->added_lines);
+}
+
+void History_add(History* self, const char* line, size_t len) {
+    const char* newest;
+    size_t newest_len;
+    if (len == 0 || memchr(line, '\n', len) != NULL ||
+        (History_get(self, 0, &newest, &newest_len) && newest_len == len &&
+         memcmp(newest, line, len) == 0)) {
+        return;
+    }
+
+    const size_t start = self->added.size;
+    HistorySpans_append(&self->added_lines, (HistorySpan){.start = start, .len = len});
+    String_appendSlice(&self->added, line, len);
+    String_append(&self->added, '\n');
+
+    if (self->fd != -1) {
+        // with `O_APPEND` a single write lands in one piece after what the other shells wrote
+        if (write(self->fd, self->added.items + start, len + 1) == -1) {
+            close(self->fd);
+            self->fd = -1;
+        }
+    }
+}
+
+/// Finds the next older line of the file. Returns `false` if all of them are found already
+static bool History_scanFileLine(History* self) {
+    while (self->unscanned > 0) {
+        size_t end = self->unscanned;
+        if (self->mapped[end - 1] == '\n') {
+            end -= 1;
+        }
+        const char* newline = memrchr(self->mapped, '\n', end);
+        const size_t start = (newline != NULL) ? (size_t)(newline - self->mapped) + 1 : 0;
+        self->unscanned = start;
+        if (end > start) {
+            HistorySpans_append(&self->file_lines,
+                                (HistorySpan){.start = start, .len = end - start});
+            return true;
+        }
+    }
+    return false;
+}
+
+bool History_get(History* self, size_t index, const char** line, size_t* len) {
+    assert(self);
+    if (index < self->added_lines.size) {
+        const HistorySpan span = self->added_lines.items[self->added_lines.size - 1 - index];
+        *line = self->added.items + span.start;
+        *len = span.len;
+        return true;
+    }
+
+    index -= self->added_lines.size;
+    while (index >= self->file_lines.size) {
+        if (!History_scanFileLine(self)) {
+            return false;
+        }
+    }
+    const HistorySpan span = self->file_lines.items[index];
+    *line = self->mapped + span.start;
+    *len = span.len;
+    return true;
+}
+
+bool History_search(History* self, size_t from, const char* needle, size_t needle_len,
+                    size_t* index, size_t* offset) {
+    const char* line;
+    size_t len;
+    for (size_t i = from; History_get(self, i, &line, &len); ++i) {
+        const char* found = memmem(line, len, needle, needle_len);
+        if (found != NULL) {
+            *index = i;
+            *offset = (size_t)(found - line);
+            return true;
+        }
+    }
+    return false;
+}
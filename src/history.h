@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "array_list.h"
+#include "dyn_string.h"
+
+typedef struct {
+    size_t start;
+    size_t len;
+} HistorySpan;
+
+ARRAY_LIST_STRUCT(HistorySpan, HistorySpans)
+
+/// Lines entered in the REPL. The history file is only appended to, each line with a single
+/// write, so concurrent shells don't mix their lines. It is mapped at startup and its lines are
+/// found from the end when navigation or search first reaches them, so startup doesn't read it
+typedef struct {
+    /// `-1` if there is no history file
+    int fd;
+    /// the history file as it was when the shell started
+    char* mapped;
+    size_t mapped_len;
+    /// lines of `mapped` found so far, the newest first, and where the part not looked at ends
+    HistorySpans file_lines;
+    size_t unscanned;
+    /// lines entered in this shell, the oldest first, each followed by a newline
+    String added;
+    HistorySpans added_lines;
+} History;
+
+/// Without a `path` the history is kept in memory only
+void History_init(History* self, const char* path);
+void History_deinit(History* self);
+
+/// Empty lines and repeats of the newest line are not added
+void History_add(History* self, const char* line, size_t len);
+
+/// `index` `0` is the newest line. The line is valid until the next `History_add`. Returns
+/// `false` if the history is shorter
+bool History_get(History* self, size_t index, const char** line, size_t* len);
+
+/// Looks for the newest line containing `needle`, starting at `from`. Stores its index and where
+/// in it `needle` is
+bool History_search(History* self, size_t from, const char* needle, size_t needle_len,
+                    size_t* index, size_t* offset);
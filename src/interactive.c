@@ -1,6 +1,5 @@
 #include "interactive.h"
 
-#include <ctype.h>
 #include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -12,8 +11,10 @@
 #include <unistd.h>
 
 #include "common.h"
+#include "completion.h"
 #include "dyn_string.h"
 #include "executor.h"
+#include "history.h"
 
 // turn off the formatter because it can break some literals
 // clang-format off
@@ -35,16 +36,14 @@
 #define CURSOR_LINE_START ANSI_LITERAL(G)
 #define CURSOR_RESTORE ANSI_LITERAL(u)
 #define CURSOR_TOPLEFT ANSI_LITERAL(;H)
-#define CURSOR_NEXTLINE ANSI_LITERAL(E)
-#define SCROLL_UP ANSI_LITERAL(S)
 #define CLEAR_SCREEN ANSI_LITERAL(2J)
-#define DSR ANSI_LITERAL(6n) /* Device Status Report */
 // clang-format on
 
 static struct termios orig_termios;
 static struct {
     size_t win_rows, win_cols;
-    size_t row, col;
+    /// the column of the cursor, tracked from what the shell writes itself
+    size_t col;
     size_t line_start;
     enum {
         State_Normal,
@@ -53,25 +52,123 @@ static struct {
     } read_state;
     bool awaiting_command;
     bool need_more_input;
-    String command;
     String line;
+    /// output composed for the terminal, written once per batch of input by `flushFrame`
+    String frame;
+    /// the line as it is on the terminal and the column of the cursor there
+    String shown;
+    size_t shown_col;
+    History history;
+    /// how many lines back in the history the line is from, `0` for a new line
+    size_t history_pos;
+    /// the new line, kept while going through the history
+    String saved_line;
+    /// ctrl+R search, the line found is shown until the search ends
+    bool searching;
+    bool search_found;
+    bool search_failed;
+    String search_query;
+    size_t search_index;
+    size_t search_offset;
+    /// what is shown in place of the line while searching
+    String view;
+    Completer completer;
     Executor executor;
 } state;
 
-static void stdoutWrite(const char* s, size_t n) {
-    fwrite(s, 1, n, stdout);
+static void frameWrite(const char* s, size_t n) {
+    String_appendSlice(&state.frame, s, n);
 }
 
-static void stdoutFlush(void) {
-    fflush(stdout);
+#define frameWriteLiteral(lit) frameWrite(lit, sizeof(lit) - 1)
+
+static void flushFrame(void) {
+    size_t written = 0;
+    while (written < state.frame.size) {
+        ssize_t n = write(STDOUT_FILENO, state.frame.items + written, state.frame.size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+    String_clear(&state.frame);
 }
 
 static void stderrWrite(const char* s, size_t n) {
     fwrite(s, 1, n, stderr);
 }
 
-#define stdoutWriteLiteral(lit) stdoutWrite(lit, sizeof(lit))
-#define stderrWriteLiteral(lit) stderrWrite(lit, sizeof(lit))
+/// Moves the cursor along the line from column `from` to `to`
+static void frameMoveCursor(size_t from, size_t to) {
+    char seq[32];
+    int len = 0;
+    // clang-format off
+    if (to < from) {
+        len = snprintf(seq, sizeof(seq), ANSI_LITERAL(%zuD), from - to);
+    } else if (to > from) {
+        len = snprintf(seq, sizeof(seq), ANSI_LITERAL(%zuC), to - from);
+    }
+    // clang-format on
+    frameWrite(seq, (size_t)len);
+}
+
+/// Brings the terminal up to date with `line` and the cursor at `col`. Only what follows the
+/// first character that differs from the shown line is rewritten
+static void renderText(const String* line, size_t col) {
+    String* shown = &state.shown;
+    size_t same = 0;
+    while (same < line->size && same < shown->size && line->items[same] == shown->items[same]) {
+        same += 1;
+    }
+
+    if (same < line->size || same < shown->size) {
+        frameMoveCursor(state.shown_col, state.line_start + same);
+        frameWrite(line->items + same, line->size - same);
+        if (shown->size > line->size) {
+            frameWriteLiteral(ANSI_LITERAL(0K));  // clear to the end of the line
+        }
+        state.shown_col = state.line_start + line->size;
+
+        String_removeSlice(shown, same, shown->size);
+        if (line->size > same) {
+            String_appendSlice(shown, line->items + same, line->size - same);
+        }
+    }
+    frameMoveCursor(state.shown_col, col);
+    state.shown_col = col;
+}
+
+static void renderLine(void) {
+    if (!state.searching) {
+        renderText(&state.line, state.col);
+        return;
+    }
+
+    String* view = &state.view;
+    String_clear(view);
+    if (state.search_failed) {
+        String_appendSlice(view, "(failed ", strlen("(failed "));
+    } else {
+        String_append(view, '(');
+    }
+    String_appendSlice(view, "reverse-i-search)`", strlen("reverse-i-search)`"));
+    if (state.search_query.size > 0) {
+        String_appendSlice(view, state.search_query.items, state.search_query.size);
+    }
+    String_appendSlice(view, "': ", strlen("': "));
+
+    size_t col = state.line_start + view->size;
+    const char* found;
+    size_t found_len;
+    if (state.search_found &&
+        History_get(&state.history, state.search_index, &found, &found_len)) {
+        col += state.search_offset;
+        String_appendSlice(view, found, found_len);
+    }
+    renderText(view, col);
+}
 
 static void disableRawMode(void) {
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
@@ -89,40 +186,26 @@ static void enableRawMode(void) {
 
 static void updateWindowSize(void) {
     struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == -1) {
+        w.ws_row = 0;
+        w.ws_col = 0;
+    }
     state.win_rows = w.ws_row;
     state.win_cols = w.ws_col;
 }
 
-static void updateCursorPosition(void) {
-    state.row = 0;
-    state.col = 0;
-
-    stdoutWriteLiteral(DSR);
-    stdoutFlush();
-    char c;
-    size_t* cur_dim = &state.row;
-    // terminal replies with `ESC[n;mR`, where `n` is row and `m` is col
-    while (read(STDIN_FILENO, &c, 1) == 1 && c != 'R') {
-        if (!isdigit(c)) {
-            if (c == ';') {
-                if (*cur_dim == 0) {
-                    *cur_dim = 1;
-                }
-                cur_dim = &state.col;
-            }
-            continue;
-        }
-        *cur_dim *= 10;
-        *cur_dim += (size_t)(c - '0');
+/// Puts the cursor at the start of an empty line without asking the terminal where it is. A
+/// marker followed by enough spaces to fill a line is written and the cursor is returned to the
+/// start of the line. If the output before ended with a newline, that is the line the marker is
+/// on and it is cleared. Otherwise the spaces wrap, so the marker is left after the incomplete
+/// output and the cursor is on a new line
+static void startFreshLine(void) {
+    if (state.win_cols > 1) {
+        frameWriteLiteral(BG_BRIGHT_WHITE COLOR_BLACK "#" COLOR_RESET);
+        String_appendN(&state.frame, state.win_cols - 1, ' ');
+        frameWriteLiteral("\r" ANSI_LITERAL(0K));
     }
-    if (*cur_dim == 0) {
-        *cur_dim = 1;
-    }
-
-    // because the values are starting from 1 (WHY? WHY???)
-    state.row -= 1;
-    state.col -= 1;
+    state.col = 0;
 }
 
 static void handle_sigint(int sig) {
@@ -130,10 +213,12 @@ static void handle_sigint(int sig) {
     signal(sig, handle_sigint);
 }
 
+/// The frame is not touched in the handler, the main loop takes the new size before it renders
+static volatile sig_atomic_t window_resized = 0;
+
 static void handle_winch(int sig) {
     UNUSED(sig);
-    updateWindowSize();
-    updateCursorPosition();
+    window_resized = 1;
     signal(SIGWINCH, handle_winch);
 }
 
@@ -141,14 +226,23 @@ static void deinit(void) {
     disableRawMode();
     Executor_deinit(&state.executor);
     String_deinit(&state.line);
+    String_deinit(&state.frame);
+    String_deinit(&state.shown);
+    History_deinit(&state.history);
+    String_deinit(&state.saved_line);
+    String_deinit(&state.search_query);
+    String_deinit(&state.view);
+    Completer_deinit(&state.completer);
 }
 
 static void init(void) {
+    String_init(&state.frame);
+    String_init(&state.shown);
     atexit(deinit);
     signal(SIGWINCH, handle_winch);
     enableRawMode();
     updateWindowSize();
-    updateCursorPosition();
+    startFreshLine();
 
     signal(SIGINT, handle_sigint);
 
@@ -161,14 +255,33 @@ static void init(void) {
 
     Executor_setVarCStrs(&state.executor, "PS1", "$ ", false);
     Executor_setVarCStrs(&state.executor, "PS2", "> ", false);
+
+    String path;
+    String_init(&path);
+    const char* histfile = Executor_getVarCStr(&state.executor, "HISTFILE");
+    const char* home = Executor_getVarCStr(&state.executor, "HOME");
+    if (histfile != NULL) {
+        String_appendSlice(&path, histfile, strlen(histfile));
+    } else if (home != NULL) {
+        String_appendSlice(&path, home, strlen(home));
+        String_appendSlice(&path, "/.blush_history", strlen("/.blush_history"));
+    }
+    String_append(&path, '\0');
+    History_init(&state.history, (path.size > 1) ? path.items : NULL);
+    String_deinit(&path);
+
+    state.history_pos = 0;
+    String_init(&state.saved_line);
+    state.searching = false;
+    String_init(&state.search_query);
+    String_init(&state.view);
+    Completer_init(&state.completer);
 }
 
 static void moveToNextLine(void) {
-    if (state.row >= state.win_rows - 1) {
-        stdoutWriteLiteral(SCROLL_UP);
-    }
+    // the terminal scrolls by itself on a newline at the bottom, unlike with a cursor movement
     state.col = 0;
-    stdoutWriteLiteral(CURSOR_NEXTLINE);
+    frameWriteLiteral("\r\n");
 }
 
 static void prompt(void) {
@@ -179,9 +292,174 @@ static void prompt(void) {
         prompt = Executor_getVarCStr(&state.executor, "PS2");
     }
     size_t len = strlen(prompt);
+    flushFrame();
     stderrWrite(prompt, len);
     state.line_start = len;
     state.col += len;
+
+    // the line is drawn anew after the prompt
+    String_clear(&state.shown);
+    state.shown_col = len;
+}
+
+static void setLine(const char* s, size_t len) {
+    String_clear(&state.line);
+    if (len > 0) {
+        String_appendSlice(&state.line, s, len);
+    }
+    state.col = state.line_start + len;
+}
+
+static void saveLine(void) {
+    String_clear(&state.saved_line);
+    if (state.line.size > 0) {
+        String_appendSlice(&state.saved_line, state.line.items, state.line.size);
+    }
+}
+
+/// Shows the next older or newer line of the history, the new line is kept while away from it
+static void moveInHistory(bool older) {
+    const char* line;
+    size_t len;
+    if (older) {
+        if (!History_get(&state.history, state.history_pos, &line, &len)) {
+            return;
+        }
+        if (state.history_pos == 0) {
+            saveLine();
+        }
+        state.history_pos += 1;
+        setLine(line, len);
+    } else if (state.history_pos > 0) {
+        state.history_pos -= 1;
+        if (state.history_pos == 0) {
+            setLine(state.saved_line.items, state.saved_line.size);
+        } else if (History_get(&state.history, state.history_pos - 1, &line, &len)) {
+            setLine(line, len);
+        }
+    }
+}
+
+static void searchFrom(size_t from) {
+    size_t index, offset;
+    if (History_search(&state.history, from, state.search_query.items, state.search_query.size,
+                       &index, &offset)) {
+        state.search_found = true;
+        state.search_failed = false;
+        state.search_index = index;
+        state.search_offset = offset;
+    } else {
+        state.search_failed = true;
+    }
+}
+
+static void startSearch(void) {
+    if (state.history_pos == 0) {
+        saveLine();
+    }
+    state.searching = true;
+    state.search_found = false;
+    state.search_failed = false;
+    String_clear(&state.search_query);
+}
+
+/// Edits the search, every change looks for the query again. Other keys end the search with the
+/// line found and return `false`, they are then handled as usual
+static bool readCharSearch(int c) {
+    if (c == 18) {  // ctrl+R, the next older match
+        if (state.search_found) {
+            searchFrom(state.search_index + 1);
+        }
+    } else if (c == 7) {  // ctrl+G, back to the line from before
+        state.searching = false;
+    } else if (c == 8 || c == 127) {
+        if (state.search_query.size > 0) {
+            String_pop(&state.search_query);
+        }
+        state.search_found = false;
+        state.search_failed = false;
+        if (state.search_query.size > 0) {
+            searchFrom(0);
+        }
+    } else if (c >= ' ') {
+        String_append(&state.search_query, (char)c);
+        searchFrom(state.search_found ? state.search_index : 0);
+    } else {
+        const char* line;
+        size_t len;
+        if (state.search_found &&
+            History_get(&state.history, state.search_index, &line, &len)) {
+            setLine(line, len);
+            state.history_pos = state.search_index + 1;
+        }
+        state.searching = false;
+        return false;
+    }
+    return true;
+}
+
+#define MAX_LISTED_CANDIDATES 200
+
+/// Shows the candidates under the line, the prompt and the line are drawn again after them
+static void listCandidates(const Candidates* candidates) {
+    const size_t cursor = state.col - state.line_start;
+    renderLine();
+    moveToNextLine();
+    for (size_t i = 0; i < candidates->size && i < MAX_LISTED_CANDIDATES; ++i) {
+        const Candidate* candidate = &candidates->items[i];
+        frameWrite(candidate->name, strlen(candidate->name));
+        if (candidate->is_dir) {
+            frameWriteLiteral("/");
+        }
+        frameWriteLiteral("  ");
+    }
+    if (candidates->size > MAX_LISTED_CANDIDATES) {
+        char more[32];
+        const int len = snprintf(more, sizeof(more), "(%zu more)",
+                                 candidates->size - MAX_LISTED_CANDIDATES);
+        frameWrite(more, (size_t)len);
+    }
+    moveToNextLine();
+    state.col = cursor;
+    state.awaiting_command = true;
+}
+
+/// Completes the word before the cursor as far as all candidates agree, a single candidate is
+/// finished with a space or a `/`. If nothing can be added, the candidates are listed
+static void complete(void) {
+    const size_t cursor = state.col - state.line_start;
+    size_t start;
+    const Candidates* candidates = Completer_complete(
+        &state.completer, &state.executor, (state.line.size > 0) ? state.line.items : "", cursor,
+        &start);
+    if (candidates->size == 0) {
+        return;
+    }
+
+    const char* first = candidates->items[0].name;
+    size_t common = strlen(first);
+    for (size_t i = 1; i < candidates->size; ++i) {
+        size_t j = 0;
+        while (j < common && candidates->items[i].name[j] == first[j]) {
+            j += 1;
+        }
+        common = j;
+    }
+
+    const size_t typed = cursor - start;
+    if (candidates->size > 1 && common <= typed) {
+        listCandidates(candidates);
+        return;
+    }
+    for (size_t i = typed; i < common; ++i) {
+        String_insert(&state.line, first[i], state.col - state.line_start);
+        state.col += 1;
+    }
+    if (candidates->size == 1) {
+        String_insert(&state.line, candidates->items[0].is_dir ? '/' : ' ',
+                      state.col - state.line_start);
+        state.col += 1;
+    }
 }
 
 static void readCharNormal(char c) {
@@ -189,10 +467,11 @@ static void readCharNormal(char c) {
         case 0x1B:  // escape character
             state.read_state = State_EscSeq;
             break;
+        case 18:  // ctrl+R
+            startSearch();
+            break;
         case 12:  // form feed
-            stdoutWriteLiteral(CLEAR_SCREEN CURSOR_TOPLEFT);
-            stdoutFlush();
-            state.row = 0;
+            frameWriteLiteral(CLEAR_SCREEN CURSOR_TOPLEFT);
             state.col = 0;
             state.awaiting_command = true;
             break;
@@ -201,143 +480,148 @@ static void readCharNormal(char c) {
             if (state.col - state.line_start <= state.line.size && state.col > state.line_start) {
                 String_remove(&state.line, state.col - state.line_start - 1);
                 state.col -= 1;
-
-                // clang-format off
-                printf(ANSI_LITERAL(%zuG), state.line_start + 1);
-                // clang-format on
-                stdoutWriteLiteral(ANSI_LITERAL(0K));  // clear to the end of the line
-                stdoutWrite(state.line.items, state.line.size);
-
-                // clang-format off
-                printf(ANSI_LITERAL(%zuG), state.col + 1);
-                // clang-format on
-
-                stdoutFlush();
             }
             break;
         case '\t':
-            // TODO: completions
+            complete();
             break;
         case '\r':
         case '\n':
+            renderLine();
             moveToNextLine();
-            stdoutFlush();
+            flushFrame();
+
+            History_add(&state.history, state.line.items, state.line.size);
+            state.history_pos = 0;
 
-            String_appendSlice(&state.command, state.line.items, state.line.size);
+            // the executor keeps what an incomplete command needs, so only the new line is passed
+            String_append(&state.line, '\n');
 
             disableRawMode();
-            switch (Executor_execute(&state.executor, state.command.items, state.command.size)) {
+            switch (Executor_execute(&state.executor, state.line.items, state.line.size)) {
                 case ExecutionResult_Success:
-                    state.need_more_input = false;
-                    String_clear(&state.command);
-                    break;
                 case ExecutionResult_Failure:
-                    fprintf(stderr, "Command not found\n");
-                    state.need_more_input = false;
-                    String_clear(&state.command);
-                    break;
                 case ExecutionResult_Error:
+                case ExecutionResult_SyntaxError:
                     state.need_more_input = false;
-                    String_clear(&state.command);
-                    perror("Failed to execute command");
                     break;
                 case ExecutionResult_NeedMoreInput:
                     state.need_more_input = true;
                     break;
             }
+            Executor_notifyJobs(&state.executor);
             enableRawMode();
             updateWindowSize();
-            updateCursorPosition();
 
+            // the output of the command may have left the cursor anywhere
             String_clear(&state.line);
-            if (state.col != 0) {
-                stdoutWriteLiteral(BG_BRIGHT_WHITE COLOR_BLACK "#" COLOR_RESET);
-                moveToNextLine();
-            }
-            stdoutFlush();
+            startFreshLine();
             state.awaiting_command = true;
             break;
         default:
             String_insert(&state.line, (char)c, state.col - state.line_start);
-            stdoutWriteLiteral(CURSOR_SAVE);
-            stdoutWrite(state.line.items + (state.col - state.line_start),
-                        state.line.size - (state.col - state.line_start));
-            stdoutWriteLiteral(CURSOR_RESTORE CURSOR_FORWARD);
-            stdoutFlush();
             state.col += 1;
             break;
     }
 }
 
+/// Returns `false` once the input is over
+static bool readChar(int c) {
+    if (state.awaiting_command) {
+        prompt();
+        state.awaiting_command = false;
+    }
+
+    if (c == 3) {  // ctrl+C
+        Executor_discardInput(&state.executor);
+        String_clear(&state.line);
+        state.history_pos = 0;
+        state.searching = false;
+        if (state.need_more_input) {
+            state.need_more_input = false;
+            frameWriteLiteral(CURSOR_LINE_START);
+        } else {
+            moveToNextLine();
+        }
+
+        state.awaiting_command = true;
+        state.col = 0;
+        return true;
+    }
+    if (c == 4) {  // ctrl+D
+        return false;
+    }
+
+    // printf("%d ", c);
+
+    if (state.searching && state.read_state == State_Normal && readCharSearch(c)) {
+        return true;
+    }
+
+    switch (state.read_state) {
+        case State_Normal:
+            readCharNormal((char)c);
+            break;
+        case State_EscSeq:
+            if (c == '[') {
+                state.read_state = State_CtrlSeq;
+            } else {
+                state.read_state = State_Normal;
+            }
+            break;
+        case State_CtrlSeq:
+            switch (c) {
+                case 'A':  // cursor up
+                    moveInHistory(true);
+                    break;
+                case 'B':  // cursor down
+                    moveInHistory(false);
+                    break;
+                case 'C':  // cursor forward
+                    if (state.col - state.line_start + 1 <= state.line.size) {
+                        state.col += 1;
+                    }
+                    break;
+                case 'D':  // cursor back
+                    if (state.col > state.line_start) {
+                        state.col -= 1;
+                    }
+                    break;
+            }
+            state.read_state = State_Normal;
+            break;
+    }
+    return true;
+}
+
 void replLoop(void) {
     init();
 
+    // everything that arrived at once, e.g. a paste or an escape sequence, is handled before the
+    // terminal is updated
+    char input[256];
     for (;;) {
+        if (window_resized) {
+            window_resized = 0;
+            updateWindowSize();
+        }
         if (state.awaiting_command) {
             prompt();
             state.awaiting_command = false;
         }
+        renderLine();
+        flushFrame();
 
-        int c = getchar();
-        if (c == EOF && errno == 4) {
-            // errno == 4 means "Interrupted syscall"
-            continue;
-        }
-        if (c == 3) {  // ctrl+C
-            String_clear(&state.command);
-            String_clear(&state.line);
-            if (state.need_more_input) {
-                state.need_more_input = false;
-                stdoutWriteLiteral(CURSOR_LINE_START);
-            } else {
-                stdoutWriteLiteral(CURSOR_NEXTLINE);
-            }
-            stdoutFlush();
-
-            state.awaiting_command = true;
-            state.col = 0;
+        const ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+        if (n < 0 && errno == EINTR) {
             continue;
-        }
-        if (c == 4 || (c == EOF && errno == 0)) {  // ctrl+D
+        } else if (n <= 0) {
             break;
         }
-
-        // printf("%d ", c);
-
-        switch (state.read_state) {
-            case State_Normal:
-                readCharNormal((char)c);
-                break;
-            case State_EscSeq:
-                if (c == '[') {
-                    state.read_state = State_CtrlSeq;
-                } else {
-                    state.read_state = State_Normal;
-                }
-                break;
-            case State_CtrlSeq:
-                switch (c) {
-                    case 'A':  // cursor up
-                        break;
-                    case 'B':  // cursor down
-                        break;
-                    case 'C':  // cursor forward
-                        if (state.col - state.line_start + 1 <= state.line.size) {
-                            state.col += 1;
-                            stdoutWriteLiteral(CURSOR_FORWARD);
-                            stdoutFlush();
-                        }
-                        break;
-                    case 'D':  // cursor back
-                        if (state.col > state.line_start) {
-                            state.col -= 1;
-                            stdoutWriteLiteral(CURSOR_BACK);
-                            stdoutFlush();
-                        }
-                        break;
-                }
-                state.read_state = State_Normal;
-                break;
+        for (ssize_t i = 0; i < n; ++i) {
+            if (!readChar((unsigned char)input[i])) {
+                return;
+            }
         }
     }
 }
@@ -0,0 +1,241 @@
+#include "jobs.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "alloc.h"
+#include "reaper.h"
+
+ARRAY_LIST_SIGNATURES(Job, Jobs)
+ARRAY_LIST_IMPL(Job, Jobs)
+
+void JobTable_init(JobTable* self) {
+    assert(self);
+    Jobs_init(&self->jobs);
+}
+
+static void Job_deinit(Job* self) {
+    free(self->procs);
+    free(self->text);
+}
+
+void JobTable_deinit(JobTable* self) {
+    for (size_t i = 0; i < self->jobs.size; ++i) {
+        Job_deinit(&self->jobs.items[i]);
+    }
+    Jobs_deinit(&self->jobs);
+}
+
+/// Same as for a pipeline run in the foreground
+static void Job_finish(Job* self, bool pipefail) {
+    int failed_code = 0;
+    for (size_t i = 0; i < self->procs_size; ++i) {
+        if (self->procs[i].exit_code != 0) {
+            failed_code = self->procs[i].exit_code;
+        }
+    }
+    self->exit_code = (pipefail && failed_code != 0)
+                          ? failed_code
+                          : self->procs[self->procs_size - 1].exit_code;
+}
+
+/// Forgets the `count` oldest finished jobs
+static void JobTable_forgetFinished(JobTable* self, size_t count) {
+    size_t kept = 0;
+    for (size_t i = 0; i < self->jobs.size; ++i) {
+        Job* job = &self->jobs.items[i];
+        if (count > 0 && job->running == 0) {
+            Job_deinit(job);
+            count -= 1;
+        } else {
+            self->jobs.items[kept++] = *job;
+        }
+    }
+    self->jobs.size = kept;
+}
+
+size_t JobTable_add(JobTable* self, const pid_t* pids, const int* codes, size_t n,
+                    const char* text, size_t text_len, bool pipefail) {
+    assert(n > 0);
+
+    size_t finished = 0;
+    for (size_t i = 0; i < self->jobs.size; ++i) {
+        if (self->jobs.items[i].running == 0) {
+            finished += 1;
+        }
+    }
+    if (finished >= JOBS_MAX_FINISHED) {
+        JobTable_forgetFinished(self, finished - JOBS_MAX_FINISHED + 1);
+    }
+
+    // like other shells, numbers are reused once the jobs with the highest ones are gone
+    const size_t id = (self->jobs.size > 0) ? self->jobs.items[self->jobs.size - 1].id + 1 : 1;
+    Job job = {
+        .id = id,
+        .procs = mallocChecked(n * sizeof(JobProcess)),
+        .procs_size = n,
+        .running = 0,
+        .text = mallocChecked(text_len + 1),
+    };
+    for (size_t i = 0; i < n; ++i) {
+        const bool started = pids[i] != -1;
+        job.procs[i] = (JobProcess){
+            .pid = pids[i],
+            .exit_code = started ? 0 : codes[i],
+            .done = !started,
+        };
+        if (started) {
+            job.running += 1;
+        }
+    }
+    memcpy(job.text, text, text_len);
+    job.text[text_len] = '\0';
+    if (job.running == 0) {
+        Job_finish(&job, pipefail);
+    }
+    Jobs_append(&self->jobs, job);
+    return id;
+}
+
+void JobTable_reap(JobTable* self, bool pipefail) {
+    for (size_t i = 0; i < self->jobs.size; ++i) {
+        Job* job = &self->jobs.items[i];
+        for (size_t j = 0; j < job->procs_size && job->running > 0; ++j) {
+            JobProcess* proc = &job->procs[j];
+            if (proc->done) {
+                continue;
+            }
+
+            int st = 0;
+            pid_t res = waitpid(proc->pid, &st, WNOHANG);
+            if (res == proc->pid) {
+                proc->exit_code = Reaper_exitCode(st);
+            } else if (res == 0 || errno != ECHILD) {
+                continue;
+            }
+            proc->done = true;
+            job->running -= 1;
+            if (job->running == 0) {
+                Job_finish(job, pipefail);
+            }
+        }
+    }
+}
+
+static void JobTable_remove(JobTable* self, size_t index) {
+    Job job = Jobs_remove(&self->jobs, index);
+    Job_deinit(&job);
+}
+
+void JobTable_print(JobTable* self, FILE* f, bool only_finished) {
+    size_t i = 0;
+    while (i < self->jobs.size) {
+        const Job* job = &self->jobs.items[i];
+        const bool finished = job->running == 0;
+        if (only_finished && !finished) {
+            ++i;
+            continue;
+        }
+
+        // `+` marks the current job, the one started last, and `-` the previous one
+        char mark = ' ';
+        if (i + 1 == self->jobs.size) {
+            mark = '+';
+        } else if (i + 2 == self->jobs.size) {
+            mark = '-';
+        }
+
+        char state[24];
+        if (!finished) {
+            snprintf(state, sizeof(state), "Running");
+        } else if (job->exit_code == 0) {
+            snprintf(state, sizeof(state), "Done");
+        } else {
+            snprintf(state, sizeof(state), "Exit %d", job->exit_code);
+        }
+        fprintf(f, "[%zu]%c  %-24s%s%s\n", job->id, mark, state, job->text,
+                finished ? "" : " &");
+
+        if (finished) {
+            JobTable_remove(self, i);
+        } else {
+            ++i;
+        }
+    }
+    fflush(f);
+}
+
+void JobTable_waitAll(JobTable* self, bool pipefail) {
+    for (;;) {
+        JobTable_reap(self, pipefail);
+        bool running = false;
+        for (size_t i = 0; i < self->jobs.size && !running; ++i) {
+            running = self->jobs.items[i].running > 0;
+        }
+        if (!running) {
+            break;
+        }
+        Reaper_await();
+    }
+
+    while (self->jobs.size > 0) {
+        JobTable_remove(self, self->jobs.size - 1);
+    }
+}
+
+bool JobTable_waitAny(JobTable* self, bool pipefail, int* exit_code) {
+    if (self->jobs.size == 0) {
+        return false;
+    }
+
+    for (;;) {
+        JobTable_reap(self, pipefail);
+        for (size_t i = 0; i < self->jobs.size; ++i) {
+            if (self->jobs.items[i].running == 0) {
+                *exit_code = self->jobs.items[i].exit_code;
+                JobTable_remove(self, i);
+                return true;
+            }
+        }
+        Reaper_await();
+    }
+}
+
+/// Waits for the job at `index` to finish, it is then removed by the caller
+static void JobTable_awaitIndex(JobTable* self, size_t index, bool pipefail) {
+    for (;;) {
+        JobTable_reap(self, pipefail);
+        if (self->jobs.items[index].running == 0) {
+            return;
+        }
+        Reaper_await();
+    }
+}
+
+bool JobTable_waitJob(JobTable* self, size_t id, bool pipefail, int* exit_code) {
+    for (size_t i = 0; i < self->jobs.size; ++i) {
+        if (self->jobs.items[i].id == id) {
+            JobTable_awaitIndex(self, i, pipefail);
+            *exit_code = self->jobs.items[i].exit_code;
+            JobTable_remove(self, i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobTable_waitPid(JobTable* self, pid_t pid, bool pipefail, int* exit_code) {
+    for (size_t i = 0; i < self->jobs.size; ++i) {
+        for (size_t j = 0; j < self->jobs.items[i].procs_size; ++j) {
+            if (self->jobs.items[i].procs[j].pid == pid) {
+                JobTable_awaitIndex(self, i, pipefail);
+                *exit_code = self->jobs.items[i].procs[j].exit_code;
+                JobTable_remove(self, i);
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "array_list.h"
+
+typedef struct {
+    /// `-1` if the stage could not be started
+    pid_t pid;
+    int exit_code;
+    bool done;
+} JobProcess;
+
+typedef struct {
+    /// number `jobs` shows and `wait` accepts as `%n`
+    size_t id;
+    JobProcess* procs;
+    size_t procs_size;
+    /// how many of `procs` have not exited yet
+    size_t running;
+    /// exit code of the whole pipeline, valid once `running` is `0`
+    int exit_code;
+    char* text;
+} Job;
+
+ARRAY_LIST_STRUCT(Job, Jobs)
+
+/// Finished jobs kept at most. Nothing reports them in scripts unless they use `jobs` or `wait`,
+/// so without a limit a script starting many jobs would grow the table without bound
+#define JOBS_MAX_FINISHED 1024
+
+/// Pipelines running in the background, in the order they were started. Finished jobs are kept
+/// until their status is reported by `JobTable_print` or collected by one of the waits, or until
+/// there are more than `JOBS_MAX_FINISHED` of them, then the oldest ones are forgotten
+typedef struct {
+    Jobs jobs;
+} JobTable;
+
+void JobTable_init(JobTable* self);
+void JobTable_deinit(JobTable* self);
+
+/// Adds a job of `n` stages, `codes` are the exit codes of those that were not started.
+/// Returns its id
+size_t JobTable_add(JobTable* self, const pid_t* pids, const int* codes, size_t n,
+                    const char* text, size_t text_len, bool pipefail);
+
+/// Collects the processes that exited, without blocking
+void JobTable_reap(JobTable* self, bool pipefail);
+
+/// Prints the jobs like `jobs` does, finished ones are removed after they are printed
+void JobTable_print(JobTable* self, FILE* f, bool only_finished);
+
+/// Waits for every job and forgets them
+void JobTable_waitAll(JobTable* self, bool pipefail);
+
+/// Waits until some job finishes and stores its exit code. Returns `false` if there are no jobs
+bool JobTable_waitAny(JobTable* self, bool pipefail, int* exit_code);
+
+/// Waits for the job with `id`. Returns `false` if there is no such job
+bool JobTable_waitJob(JobTable* self, size_t id, bool pipefail, int* exit_code);
+
+/// Waits for the job `pid` belongs to and stores the exit code of `pid`. Returns `false` if no
+/// job has that process
+bool JobTable_waitPid(JobTable* self, pid_t pid, bool pipefail, int* exit_code);
@@ -1,93 +1,131 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "dyn_string.h"
 #include "executor.h"
 #include "interactive.h"
+#include "trace.h"
 
-static int execFile(const char* const* const argv, unsigned argc) {
-    assert(argc > 0);
-    assert(argc <= INT_MAX);
+#define READ_CHUNK 65536
 
-    const char* path = argv[0];
-    FILE* f = fopen(path, "r");
-    if (!f) {
-        perror("Could not open input file");
-        return 1;
+typedef struct {
+    char* data;
+    size_t len;
+    bool mapped;
+} Script;
+
+/// Regular files are mapped into memory, anything else (e.g. a pipe) is read in large blocks
+static bool Script_load(Script* self, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
     }
 
-    int res = 0;
-    size_t line = 1;
-    size_t unterminated_char_line = 0;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
 
-    Executor executor;
-    Executor_init(&executor);
-    for (unsigned i = 0; i < argc; ++i) {
-        char buf[11];
-        snprintf(buf, sizeof(buf), "%u", i);
-        Executor_setVarCStrs(&executor, buf, argv[i], true);
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            close(fd);
+            posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            *self = (Script){.data = data, .len = (size_t)st.st_size, .mapped = true};
+            return true;
+        }
     }
 
     String buf;
     String_init(&buf);
-
-    int c;
-    while ((c = fgetc(f)) != EOF || buf.size > 0) {
-        if (c == EOF && unterminated_char_line != 0) {
+    for (;;) {
+        String_ensureCapacity(&buf, buf.size + READ_CHUNK);
+        ssize_t len = read(fd, buf.items + buf.size, buf.cap - buf.size);
+        if (len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            String_deinit(&buf);
+            close(fd);
+            return false;
+        }
+        if (len == 0) {
             break;
         }
+        buf.size += (size_t)len;
+    }
+    close(fd);
+    *self = (Script){.data = buf.items, .len = buf.size, .mapped = false};
+    return true;
+}
 
-        if ((c == '\r' || c == '\n' || c == EOF) && buf.size > 0) {
-            ExecutionResult res = Executor_execute(&executor, buf.items, buf.size);
+static void Script_unload(Script* self) {
+    if (self->mapped) {
+        munmap(self->data, self->len);
+    } else {
+        free(self->data);
+    }
+}
 
-            if (res == ExecutionResult_NeedMoreInput) {
-                unterminated_char_line = line;
-            } else {
-                unterminated_char_line = 0;
-            }
+static int execFile(const char* const* const argv, unsigned argc) {
+    assert(argc > 0);
+    assert(argc <= INT_MAX);
 
-            switch (res) {
-                case ExecutionResult_Success:
-                case ExecutionResult_Error:
-                case ExecutionResult_Failure:
-                    String_clear(&buf);
-                    break;
-                case ExecutionResult_NeedMoreInput:
-                    break;
-            }
+    const char* path = argv[0];
+    Script script;
+    TraceTime trace_start = Trace_begin();
+    const bool loaded = Script_load(&script, path);
+    Trace_end("load_script", path, trace_start);
+    if (!loaded) {
+        perror("Could not open input file");
+        return 1;
+    }
 
-            switch (res) {
-                case ExecutionResult_Failure:
-                    fprintf(stderr, "%s: line %zu: Command not found\n", path, line);
-                    break;
-                case ExecutionResult_Error:
-                    fprintf(stderr, "%s: line %zu: Failed to execute command: %s\n", path, line,
-                            strerror(errno));
-                    break;
-                case ExecutionResult_Success:
-                case ExecutionResult_NeedMoreInput:
-                    break;
-            }
-            line += 1;
-        }
-        if (c != EOF) {
-            String_append(&buf, (char)c);
-        }
+    Executor executor;
+    Executor_init(&executor);
+    executor.script_path = path;
+    for (unsigned i = 0; i < argc; ++i) {
+        char num[11];
+        snprintf(num, sizeof(num), "%u", i);
+        Executor_setVarCStrs(&executor, num, argv[i], true);
     }
 
-    if (unterminated_char_line != 0) {
-        fprintf(stderr,
-                "Failed to execute command because of "
-                "unterminated character on line %zu\n",
-                unterminated_char_line);
-        res = 1;
+    // the whole script is parsed before anything runs
+    int res = 0;
+    Arena arena;
+    Arena_init(&arena);
+    Program program;
+    ParseError error;
+    trace_start = Trace_begin();
+    const ParseResult parsed = Program_parse(&program, &arena, script.data, script.len, &error);
+    Trace_end("parse", path, trace_start);
+    switch (parsed) {
+        case ParseResult_Success:
+            Executor_executeProgram(&executor, &program);
+            break;
+        case ParseResult_NeedMoreInput:
+            fprintf(stderr,
+                    "Failed to execute command because of "
+                    "unterminated character on line %zu\n",
+                    error.line);
+            res = 1;
+            break;
+        case ParseResult_SyntaxError:
+            Executor_reportParseError(&executor, &error);
+            res = 2;
+            break;
     }
 
-    fclose(f);
+    Arena_deinit(&arena);
     Executor_deinit(&executor);
-    String_deinit(&buf);
+    Script_unload(&script);
     return res;
 }
 
@@ -100,13 +138,12 @@ static int execString(const char* str) {
         case ExecutionResult_Success:
             break;
         case ExecutionResult_Failure:
-            fprintf(stderr, "Command not found\n");
-            res = 1;
-            break;
         case ExecutionResult_Error:
-            perror("Failed to execute command");
             res = 1;
             break;
+        case ExecutionResult_SyntaxError:
+            res = 2;
+            break;
         case ExecutionResult_NeedMoreInput:
             fprintf(stderr,
                     "Failed to execute command because of "
@@ -120,6 +157,7 @@ static int execString(const char* str) {
 }
 
 int main(int argc, const char* const* argv) {
+    Trace_init();
     if (argc == 1) {
         replLoop();
         return 0;
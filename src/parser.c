@@ -0,0 +1,905 @@
+#include "parser.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "common.h"
+#include "dyn_string.h"
+
+ARENA_ARRAY_LIST_SIGNATURES(WordPart, WordParts)
+ARENA_ARRAY_LIST_IMPL(WordPart, WordParts)
+ARENA_ARRAY_LIST_SIGNATURES(Word, Words)
+ARENA_ARRAY_LIST_IMPL(Word, Words)
+ARENA_ARRAY_LIST_SIGNATURES(Assignment, Assignments)
+ARENA_ARRAY_LIST_IMPL(Assignment, Assignments)
+ARENA_ARRAY_LIST_SIGNATURES(Redirection, Redirections)
+ARENA_ARRAY_LIST_IMPL(Redirection, Redirections)
+ARENA_ARRAY_LIST_SIGNATURES(Command, Commands)
+ARENA_ARRAY_LIST_IMPL(Command, Commands)
+ARENA_ARRAY_LIST_SIGNATURES(Pipeline, Pipelines)
+ARENA_ARRAY_LIST_IMPL(Pipeline, Pipelines)
+
+typedef enum {
+    TokenKind_Whitespace,
+    TokenKind_Newline,
+    TokenKind_Comment,
+    TokenKind_Literal,
+    TokenKind_Quoted,
+    TokenKind_Tilda,
+    TokenKind_VariableReference,
+    TokenKind_LastExitCodeReq,
+    TokenKind_CommandSubstitution,
+    TokenKind_Pipe,
+    TokenKind_Background,
+    TokenKind_And,
+    TokenKind_Or,
+    TokenKind_Semicolon,
+    TokenKind_Redirect,
+    TokenKind_Unexpected,
+} TokenKind;
+
+typedef struct {
+    TokenKind kind;
+    const char* s;
+    size_t len;
+} Token;
+
+typedef struct {
+    const char* s;
+    size_t len;
+    size_t cur;
+    Arena* arena;
+    /// the quote, `(` of a `$(` or backtick the previous piece of input ended in, `0` if none.
+    /// The token continues in the next piece and what was read of it so far is in `partial`
+    char open;
+    ArenaString partial;
+    /// nesting of parens in a `$(` and the quote open in it
+    size_t depth;
+    char inner_quote;
+    /// the last character read was an unescaped backslash in a substitution
+    bool escape_pending;
+} Tokenizer;
+
+static void Tokenizer_init(Tokenizer* self, Arena* arena) {
+    *self = (Tokenizer){
+        .s = NULL,
+        .len = 0,
+        .cur = 0,
+        .arena = arena,
+        .open = 0,
+    };
+}
+
+static void Tokenizer_setInput(Tokenizer* self, const char* input, const size_t len) {
+    self->s = input;
+    self->len = len;
+    self->cur = 0;
+}
+
+static int Tokenizer_peekChar(const Tokenizer* self) {
+    if (self->cur >= self->len) {
+        return EOF;
+    }
+    return (unsigned char)self->s[self->cur];
+}
+
+static int Tokenizer_eatChar(Tokenizer* self) {
+    int res;
+    if ((res = Tokenizer_peekChar(self)) != EOF) {
+        self->cur += 1;
+    }
+    return res;
+}
+
+static void Tokenizer_eatWhileNot(Tokenizer* self, char ch) {
+    const char* found = memchr(self->s + self->cur, ch, self->len - self->cur);
+    self->cur = (found != NULL) ? (size_t)(found - self->s) : self->len;
+}
+
+enum {
+    /// whitespace other than a newline
+    CharClass_Blank = 1 << 0,
+    /// can be a part of an unquoted argument
+    CharClass_Arg = 1 << 1,
+    /// an argument character that is not `\\`, runs of them are taken from the input as is
+    CharClass_Word = 1 << 2,
+    CharClass_Var = 1 << 3,
+};
+
+#define B CharClass_Blank
+#define A CharClass_Arg
+#define W (CharClass_Arg | CharClass_Word)
+#define V (CharClass_Arg | CharClass_Word | CharClass_Var)
+/// The same classes `ctype.h` gives in the "C" locale, bytes above `0x7f` are parts of arguments
+static const unsigned char char_classes[256] = {
+    0, W, W, W, W, W, W, W, W, B, 0, B, B, B, W, W,  // 0x0_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0x1_
+    B, W, 0, W, 0, W, 0, 0, 0, 0, W, W, W, W, W, W,  // 0x2_
+    V, V, V, V, V, V, V, V, V, V, W, 0, 0, W, 0, W,  // 0x3_
+    W, V, V, V, V, V, V, V, V, V, V, V, V, V, V, V,  // 0x4_
+    V, V, V, V, V, V, V, V, V, V, V, W, A, W, W, V,  // 0x5_
+    0, V, V, V, V, V, V, V, V, V, V, V, V, V, V, V,  // 0x6_
+    V, V, V, V, V, V, V, V, V, V, V, W, 0, W, W, W,  // 0x7_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0x8_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0x9_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0xA_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0xB_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0xC_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0xD_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0xE_
+    W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0xF_
+};
+#undef B
+#undef A
+#undef W
+#undef V
+
+static bool hasClass(int c, unsigned char cls) {
+    return c != EOF && (char_classes[(unsigned char)c] & cls) != 0;
+}
+
+static void Tokenizer_eatClass(Tokenizer* self, unsigned char cls) {
+    while (self->cur < self->len && (char_classes[(unsigned char)self->s[self->cur]] & cls)) {
+        self->cur += 1;
+    }
+}
+
+/// Skips a run of `CharClass_Word` characters. Words are checked 16 bytes at a time for control
+/// characters, whitespace and the special characters, and only those bytes are looked up
+static void Tokenizer_eatWord(Tokenizer* self) {
+#ifdef __SSE2__
+    static const char specials[] = "\"'`$()|&;<>\\";
+    const __m128i space = _mm_set1_epi8(' ');
+    while (self->cur + 16 <= self->len) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(self->s + self->cur));
+        // unsigned `chunk <= ' '`
+        __m128i hits = _mm_cmpeq_epi8(_mm_min_epu8(chunk, space), chunk);
+        for (size_t i = 0; i < sizeof(specials) - 1; ++i) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(specials[i])));
+        }
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+        while (mask != 0) {
+            const size_t pos = self->cur + (size_t)__builtin_ctz(mask);
+            if (!(char_classes[(unsigned char)self->s[pos]] & CharClass_Word)) {
+                self->cur = pos;
+                return;
+            }
+            mask &= mask - 1;
+        }
+        self->cur += 16;
+    }
+#endif
+    Tokenizer_eatClass(self, CharClass_Word);
+}
+
+static int isquote(int c) {
+    return c == '"' || c == '\'';
+}
+
+static int isargch(int c) {
+    return hasClass(c, CharClass_Arg);
+}
+
+static int isvarch(int c) {
+    return hasClass(c, CharClass_Var);
+}
+
+/// Unescaped arguments are referenced right in the input, only the ones containing backslashes
+/// are copied, a run between two backslashes at a time. An escaped newline ending the input
+/// continues the argument in the next piece of input
+static void Tokenizer_readArg(Tokenizer* self, Token* result, bool* need_more_input) {
+    size_t start = self->cur;
+    Tokenizer_eatWord(self);
+    if (Tokenizer_peekChar(self) != '\\') {
+        *result = (Token){
+            .kind = TokenKind_Literal,
+            .s = self->s + start,
+            .len = self->cur - start,
+        };
+        return;
+    }
+
+    ArenaString lit;
+    ArenaString_init(&lit, self->arena);
+    for (;;) {
+        ArenaString_appendSlice(&lit, self->s + start, self->cur - start);
+        if (Tokenizer_peekChar(self) != '\\') {
+            break;
+        }
+        self->cur += 1;  // eat `\`
+        const int c = Tokenizer_eatChar(self);
+        if (c == EOF) {
+            break;
+        }
+        ArenaString_append(&lit, (char)c);
+        if (c == '\n' && self->cur == self->len) {
+            *need_more_input = true;
+        }
+
+        start = self->cur;
+        Tokenizer_eatWord(self);
+    }
+    *result = (Token){.kind = TokenKind_Literal, .s = lit.items, .len = lit.size};
+}
+
+/// Reads the rest of a `$(` up to its `)`, skipping quoted and escaped characters. Returns
+/// `false` if the input ends first
+static bool Tokenizer_scanParenSubstitution(Tokenizer* self) {
+    int c;
+    while ((c = Tokenizer_eatChar(self)) != EOF) {
+        if (self->escape_pending) {
+            self->escape_pending = false;
+        } else if (self->inner_quote != 0) {
+            if (c == self->inner_quote) {
+                self->inner_quote = 0;
+            }
+        } else if (c == '\\') {
+            self->escape_pending = true;
+        } else if (c == '\'' || c == '"' || c == '`') {
+            self->inner_quote = (char)c;
+        } else if (c == '(') {
+            self->depth += 1;
+        } else if (c == ')' && --self->depth == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool Tokenizer_scanBacktickSubstitution(Tokenizer* self) {
+    int c;
+    while ((c = Tokenizer_eatChar(self)) != EOF) {
+        if (self->escape_pending) {
+            self->escape_pending = false;
+        } else if (c == '\\') {
+            self->escape_pending = true;
+        } else if (c == '`') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Inside backticks a backslash only escapes `$`, `` ` `` and `\`, the source is copied without
+/// those backslashes if there are any
+static void Tokenizer_unescapeBackticks(Tokenizer* self, Token* result) {
+    const char* src = result->s;
+    const size_t len = result->len;
+    if (memchr(src, '\\', len) == NULL) {
+        return;
+    }
+
+    ArenaString unescaped;
+    ArenaString_initWithCapacity(&unescaped, self->arena, len);
+    for (size_t i = 0; i < len; ++i) {
+        if (src[i] == '\\' && i + 1 < len && strchr("$`\\", src[i + 1])) {
+            i += 1;
+        }
+        ArenaString_append(&unescaped, src[i]);
+    }
+    result->s = unescaped.items;
+    result->len = unescaped.size;
+}
+
+/// Reads a quoted string or a substitution that starts at `start` or, if `self->open` is set,
+/// continues one from the previous piece of input. Tokens closed within one piece refer to the
+/// input, the others are collected in `partial`
+static void Tokenizer_readEnclosed(Tokenizer* self, char open, size_t start, Token* result,
+                                   bool* need_more_input) {
+    bool closed;
+    if (open == '(') {
+        closed = Tokenizer_scanParenSubstitution(self);
+    } else if (open == '`') {
+        closed = Tokenizer_scanBacktickSubstitution(self);
+    } else {
+        Tokenizer_eatWhileNot(self, open);
+        closed = Tokenizer_eatChar(self) != EOF;
+    }
+
+    const TokenKind kind = (open == '"' || open == '\'') ? TokenKind_Quoted
+                                                         : TokenKind_CommandSubstitution;
+    const size_t end = closed ? self->cur - 1 : self->cur;
+    if (self->open == 0 && !closed) {
+        ArenaString_init(&self->partial, self->arena);
+    }
+    if (self->open != 0 || !closed) {
+        ArenaString_appendSlice(&self->partial, self->s + start, end - start);
+    }
+
+    if (!closed) {
+        self->open = open;
+        *need_more_input = true;
+        *result = (Token){.kind = kind};
+        return;
+    }
+    if (self->open != 0) {
+        *result = (Token){.kind = kind, .s = self->partial.items, .len = self->partial.size};
+        self->open = 0;
+    } else {
+        *result = (Token){.kind = kind, .s = self->s + start, .len = end - start};
+    }
+    if (open == '`') {
+        Tokenizer_unescapeBackticks(self, result);
+    }
+}
+
+static bool Tokenizer_nextTok(Tokenizer* self, Token* result, bool* need_more_input) {
+    int c;
+    if ((c = Tokenizer_peekChar(self)) == EOF) {
+        return false;
+    }
+
+    if (self->open != 0) {
+        Tokenizer_readEnclosed(self, self->open, self->cur, result, need_more_input);
+        return true;
+    }
+
+    if (c == '\n') {
+        Tokenizer_eatChar(self);
+        *result = (Token){.kind = TokenKind_Newline};
+        return true;
+    }
+
+    if (hasClass(c, CharClass_Blank)) {
+        Tokenizer_eatClass(self, CharClass_Blank);
+        *result = (Token){.kind = TokenKind_Whitespace};
+        return true;
+    }
+
+    if (c == '#') {
+        Tokenizer_eatWhileNot(self, '\n');
+        *result = (Token){.kind = TokenKind_Comment};
+        return true;
+    } else if (c == '~') {
+        Tokenizer_eatChar(self);  // eat `~`
+        int next_ch = Tokenizer_peekChar(self);
+        if (next_ch == EOF || isspace(next_ch) || next_ch == '/') {
+            *result = (Token){.kind = TokenKind_Tilda};
+            return true;
+        } else {
+            // otherwise we should fall into `string` case
+            self->cur -= 1;
+        }
+    } else if (c == '$') {
+        Tokenizer_eatChar(self);  // eat `$`
+
+        if (Tokenizer_peekChar(self) == '?') {
+            Tokenizer_eatChar(self);  // eat '?'
+            *result = (Token){.kind = TokenKind_LastExitCodeReq};
+        } else if (Tokenizer_peekChar(self) == '(') {
+            Tokenizer_eatChar(self);  // eat '('
+            self->depth = 1;
+            self->inner_quote = 0;
+            self->escape_pending = false;
+            Tokenizer_readEnclosed(self, '(', self->cur, result, need_more_input);
+        } else {
+            size_t prev_cur = self->cur;
+            Tokenizer_eatClass(self, CharClass_Var);
+            *result = (Token){
+                .kind = TokenKind_VariableReference,
+                .s = self->s + prev_cur,
+                .len = self->cur - prev_cur,
+            };
+        }
+        return true;
+    }
+
+    if (isargch(c)) {
+        Tokenizer_readArg(self, result, need_more_input);
+        return true;
+    } else if (c == '`') {
+        Tokenizer_eatChar(self);  // eat opening backtick
+        self->escape_pending = false;
+        Tokenizer_readEnclosed(self, '`', self->cur, result, need_more_input);
+        return true;
+    } else if (isquote(c)) {
+        Tokenizer_eatChar(self);  // eat opening quote
+        Tokenizer_readEnclosed(self, (char)c, self->cur, result, need_more_input);
+        return true;
+    }
+
+    if (c == '|' || c == '&') {
+        const size_t prev_cur = self->cur;
+        Tokenizer_eatChar(self);
+        TokenKind kind = (c == '|') ? TokenKind_Pipe : TokenKind_Background;
+        if (Tokenizer_peekChar(self) == c) {
+            Tokenizer_eatChar(self);
+            kind = (c == '|') ? TokenKind_Or : TokenKind_And;
+        }
+        *result = (Token){.kind = kind, .s = self->s + prev_cur, .len = self->cur - prev_cur};
+        return true;
+    }
+
+    if (c == ';') {
+        Tokenizer_eatChar(self);
+        *result = (Token){.kind = TokenKind_Semicolon, .s = self->s + self->cur - 1, .len = 1};
+        return true;
+    }
+
+    if (c == '<' || c == '>') {
+        size_t prev_cur = self->cur;
+        Tokenizer_eatChar(self);
+        int next_ch = Tokenizer_peekChar(self);
+        if (next_ch == '&' || (c == '>' && next_ch == '>')) {
+            Tokenizer_eatChar(self);
+        }
+        *result = (Token){
+            .kind = TokenKind_Redirect,
+            .s = self->s + prev_cur,
+            .len = self->cur - prev_cur,
+        };
+        return true;
+    }
+
+    *result = (Token){.kind = TokenKind_Unexpected, .s = self->s + self->cur, .len = 1};
+    return true;
+}
+
+struct Parser {
+    Tokenizer tokenizer;
+    Arena* arena;
+    Program* program;
+    Pipeline pipeline;
+    Command cmd;
+    Word word;
+    /// the redirection the next word is the target of
+    Redirection redirection;
+    bool awaits_redirection_target;
+    size_t tok_start;
+    /// whether the current word started with an unquoted literal, so can be an assignment
+    bool word_starts_unquoted;
+    /// where the source of the current pipeline starts, `SIZE_MAX` before its first token
+    size_t pipeline_start;
+    /// the source of the current pipeline in the previous pieces of input if it started in one
+    ArenaString pipeline_text;
+    bool pipeline_carried;
+    /// position and number of the line `line_pos` is on
+    size_t line_pos;
+    size_t line;
+    /// line of the last `|`, `&&` or `||` and of the token left open at the end of the input,
+    /// `0` if none
+    size_t pipe_line;
+    size_t open_line;
+};
+
+static size_t Parser_lineAt(Parser* self, size_t pos) {
+    assert(pos >= self->line_pos);
+    for (; self->line_pos < pos; ++self->line_pos) {
+        if (self->tokenizer.s[self->line_pos] == '\n') {
+            self->line += 1;
+        }
+    }
+    return self->line;
+}
+
+static void Parser_resetCommand(Parser* self) {
+    Assignments_init(&self->cmd.assignments, self->arena);
+    Words_init(&self->cmd.words, self->arena);
+    Redirections_init(&self->cmd.redirections, self->arena);
+    self->cmd.line = 0;
+}
+
+static void Parser_resetWord(Parser* self) {
+    WordParts_init(&self->word.parts, self->arena);
+    self->word_starts_unquoted = false;
+}
+
+static bool Parser_commandIsEmpty(const Parser* self) {
+    return self->cmd.assignments.size == 0 && self->cmd.words.size == 0 &&
+           self->cmd.redirections.size == 0 && self->word.parts.size == 0 &&
+           !self->awaits_redirection_target;
+}
+
+static void Parser_addPart(Parser* self, WordPartKind kind, const char* s, size_t len) {
+    if (Parser_commandIsEmpty(self)) {
+        self->cmd.line = Parser_lineAt(self, self->tok_start);
+    }
+    WordPart part = {.kind = kind, .s = s, .len = len, .hash = 0, .program = NULL};
+    if (kind == WordPart_Variable) {
+        part.hash = hashBytes(s, len);
+    }
+    WordParts_append(&self->word.parts, part);
+}
+
+/// Returns the length of the name if `part` starts with `NAME=`
+static size_t assignmentNameLen(const WordPart* part) {
+    if (part->len == 0 || !(isalpha(part->s[0]) || part->s[0] == '_')) {
+        return 0;
+    }
+    for (size_t i = 1; i < part->len; ++i) {
+        if (part->s[i] == '=') {
+            return i;
+        }
+        if (!isvarch(part->s[i])) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/// Whether the word is the `time` keyword, which is only one at the start of a pipeline
+static bool Parser_wordIsTime(const Parser* self) {
+    const WordPart* part = &self->word.parts.items[0];
+    return self->pipeline.commands.size == 0 && !self->pipeline.timed &&
+           self->cmd.assignments.size == 0 && self->cmd.words.size == 0 &&
+           self->cmd.redirections.size == 0 && self->word_starts_unquoted &&
+           self->word.parts.size == 1 && part->kind == WordPart_Literal && part->len == 4 &&
+           memcmp(part->s, "time", 4) == 0;
+}
+
+static void Parser_finishWord(Parser* self) {
+    if (self->word.parts.size == 0) {
+        return;
+    }
+
+    size_t name_len;
+    if (self->awaits_redirection_target) {
+        self->redirection.target = self->word;
+        Redirections_append(&self->cmd.redirections, self->redirection);
+        self->awaits_redirection_target = false;
+    } else if (Parser_wordIsTime(self)) {
+        self->pipeline.timed = true;
+    } else if (self->cmd.words.size == 0 && self->word_starts_unquoted &&
+        (name_len = assignmentNameLen(&self->word.parts.items[0])) != 0) {
+        WordPart* first = &self->word.parts.items[0];
+        Assignment assignment = {.name = first->s, .name_len = name_len};
+
+        // the part after `=` is the beginning of the value
+        first->s += name_len + 1;
+        first->len -= name_len + 1;
+        assignment.value = self->word;
+        Assignments_append(&self->cmd.assignments, assignment);
+    } else {
+        Words_append(&self->cmd.words, self->word);
+    }
+    Parser_resetWord(self);
+}
+
+/// Whether the last thing parsed was a `|`, so the pipeline is not complete yet
+static bool Parser_awaitsPipeStage(const Parser* self) {
+    return self->pipeline.commands.size > 0 && Parser_commandIsEmpty(self);
+}
+
+/// Whether the last thing parsed was a `&&` or `||`, which the next pipeline has to follow
+static bool Parser_awaitsListRest(const Parser* self) {
+    return self->pipeline.commands.size == 0 && Parser_commandIsEmpty(self) &&
+           self->pipeline.condition != PipelineCondition_Always;
+}
+
+static void Parser_finishCommand(Parser* self) {
+    Parser_finishWord(self);
+    if (Parser_commandIsEmpty(self)) {
+        return;
+    }
+    Commands_append(&self->pipeline.commands, self->cmd);
+    Parser_resetCommand(self);
+}
+
+/// `end` is where the source of the pipeline ends
+static void Parser_finishPipeline(Parser* self, size_t end) {
+    Parser_finishCommand(self);
+    if (self->pipeline.commands.size == 0) {
+        // a lone `time` has nothing to time
+        self->pipeline.timed = false;
+        self->pipeline_start = SIZE_MAX;
+        self->pipeline_carried = false;
+        return;
+    }
+
+    const char* src = self->tokenizer.s + self->pipeline_start;
+    size_t len = end - self->pipeline_start;
+    if (self->pipeline_carried) {
+        ArenaString_appendSlice(&self->pipeline_text, src, len);
+        src = self->pipeline_text.items;
+        len = self->pipeline_text.size;
+    }
+    while (len > 0 && isspace(src[len - 1])) {
+        len -= 1;
+    }
+    self->pipeline.text = src;
+    self->pipeline.text_len = len;
+    Pipelines_append(&self->program->pipelines, self->pipeline);
+
+    Commands_init(&self->pipeline.commands, self->arena);
+    self->pipeline.condition = PipelineCondition_Always;
+    self->pipeline.background = false;
+    self->pipeline.timed = false;
+    self->pipeline_start = SIZE_MAX;
+    self->pipeline_carried = false;
+}
+
+/// `&` applies to the whole and/or list the last finished pipeline ends
+static void Parser_backgroundList(Parser* self) {
+    Pipelines* pipelines = &self->program->pipelines;
+    for (size_t i = pipelines->size; i > 0; --i) {
+        Pipeline* pipeline = &pipelines->items[i - 1];
+        pipeline->background = true;
+        if (pipeline->condition == PipelineCondition_Always) {
+            break;
+        }
+    }
+}
+
+static ParseResult Parser_unexpected(Parser* self, const Token* tok, ParseError* error) {
+    *error = (ParseError){
+        .line = Parser_lineAt(self, self->tok_start),
+        .token = tok->s,
+        .token_len = tok->len,
+    };
+    return ParseResult_SyntaxError;
+}
+
+static ParseResult Parser_unexpectedNewline(Parser* self, ParseError* error) {
+    const Token tok = {.kind = TokenKind_Newline, .s = "newline", .len = strlen("newline")};
+    return Parser_unexpected(self, &tok, error);
+}
+
+/// Whether the word being built is a descriptor number written right before a redirection
+static bool Parser_wordIsFd(const Parser* self) {
+    if (self->word.parts.size != 1 || !self->word_starts_unquoted) {
+        return false;
+    }
+    const WordPart* part = &self->word.parts.items[0];
+    if (part->len == 0 || part->len > 4) {
+        return false;
+    }
+    for (size_t i = 0; i < part->len; ++i) {
+        if (!isdigit(part->s[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Parser_startRedirection(Parser* self, const Token* tok) {
+    int fd = (tok->s[0] == '<') ? 0 : 1;
+    if (!self->awaits_redirection_target && Parser_wordIsFd(self)) {
+        const WordPart* part = &self->word.parts.items[0];
+        fd = 0;
+        for (size_t i = 0; i < part->len; ++i) {
+            fd = fd * 10 + (part->s[i] - '0');
+        }
+        Parser_resetWord(self);
+    } else {
+        Parser_finishWord(self);
+    }
+
+    RedirectionKind kind;
+    if (tok->len == 2 && tok->s[1] == '&') {
+        kind = Redirection_Dup;
+    } else if (tok->len == 2) {
+        kind = Redirection_Append;
+    } else if (tok->s[0] == '<') {
+        kind = Redirection_Input;
+    } else {
+        kind = Redirection_Output;
+    }
+    if (Parser_commandIsEmpty(self)) {
+        self->cmd.line = Parser_lineAt(self, self->tok_start);
+    }
+    self->redirection = (Redirection){.kind = kind, .fd = fd};
+    self->awaits_redirection_target = true;
+}
+
+static void Parser_init(Parser* self, Arena* arena, Program* program, size_t first_line) {
+    *self = (Parser){
+        .arena = arena,
+        .program = program,
+        .pipeline_start = SIZE_MAX,
+        .pipeline_carried = false,
+        .line_pos = 0,
+        .line = first_line,
+        .pipe_line = 0,
+        .open_line = 0,
+    };
+    Tokenizer_init(&self->tokenizer, arena);
+    Pipelines_init(&program->pipelines, arena);
+    Commands_init(&self->pipeline.commands, arena);
+    Parser_resetCommand(self);
+    Parser_resetWord(self);
+}
+
+Parser* Parser_create(Arena* arena, Program* program) {
+    assert(arena);
+    assert(program);
+    Parser* self = Arena_alloc(arena, sizeof(Parser));
+    Parser_init(self, arena, program, 1);
+    return self;
+}
+
+/// `first_line` is the number of the line `src` starts on
+static ParseResult Program_parseFrom(Program* program, Arena* arena, const char* src, size_t len,
+                                     size_t first_line, ParseError* error) {
+    Parser parser;
+    Parser_init(&parser, arena, program, first_line);
+    return Parser_feed(&parser, src, len, error);
+}
+
+ParseResult Program_parse(Program* program, Arena* arena, const char* src, size_t len,
+                          ParseError* error) {
+    assert(program);
+    assert(arena);
+    return Program_parseFrom(program, arena, src, len, 1, error);
+}
+
+/// The source of the substitution is parsed right away, so syntax errors in it are found before
+/// anything runs
+static ParseResult Parser_addSubstitution(Parser* self, const Token* tok, ParseError* error) {
+    const size_t line = Parser_lineAt(self, self->tok_start);
+    Program* program = Arena_alloc(self->arena, sizeof(Program));
+    ParseResult res = Program_parseFrom(program, self->arena, tok->s, tok->len, line, error);
+    if (res == ParseResult_NeedMoreInput) {
+        // the substitution is already closed, so what is missing can't follow anymore
+        *error = (ParseError){.line = line, .token = ")", .token_len = 1};
+        return ParseResult_SyntaxError;
+    } else if (res == ParseResult_Success) {
+        Parser_addPart(self, WordPart_Command, NULL, 0);
+        self->word.parts.items[self->word.parts.size - 1].program = program;
+    }
+    return res;
+}
+
+/// The token at `tok_start` is left open by the end of the input
+static ParseResult Parser_needMoreInput(Parser* self, ParseError* error) {
+    if (self->open_line == 0) {
+        self->open_line = Parser_lineAt(self, self->tok_start);
+    }
+    error->line = self->open_line;
+    return ParseResult_NeedMoreInput;
+}
+
+static ParseResult Parser_parseInput(Parser* self, ParseError* error) {
+    bool need_more_input = false;
+    Token tok;
+    while (self->tok_start = self->tokenizer.cur,
+           Tokenizer_nextTok(&self->tokenizer, &tok, &need_more_input)) {
+        if (!need_more_input) {
+            self->open_line = 0;
+        }
+        if (self->pipeline_start == SIZE_MAX && tok.kind != TokenKind_Whitespace &&
+            tok.kind != TokenKind_Comment && tok.kind != TokenKind_Newline) {
+            self->pipeline_start = self->tok_start;
+        }
+        switch (tok.kind) {
+            case TokenKind_Whitespace:
+            case TokenKind_Comment:
+                Parser_finishWord(self);
+                break;
+            case TokenKind_Newline:
+                if (self->awaits_redirection_target && self->word.parts.size == 0) {
+                    return Parser_unexpectedNewline(self, error);
+                }
+                // a pipeline may continue on the next line after `|`
+                if (!Parser_awaitsPipeStage(self)) {
+                    Parser_finishPipeline(self, self->tok_start);
+                }
+                break;
+            case TokenKind_Literal:
+                if (self->word.parts.size == 0) {
+                    self->word_starts_unquoted = true;
+                }
+                Parser_addPart(self, WordPart_Literal, tok.s, tok.len);
+                if (need_more_input) {
+                    return Parser_needMoreInput(self, error);
+                }
+                break;
+            case TokenKind_Quoted:
+                if (need_more_input) {
+                    return Parser_needMoreInput(self, error);
+                }
+                Parser_addPart(self, WordPart_Literal, tok.s, tok.len);
+                break;
+            case TokenKind_Tilda:
+                if (self->word.parts.size == 0) {
+                    Parser_addPart(self, WordPart_Home, NULL, 0);
+                } else {
+                    Parser_addPart(self, WordPart_Literal, "~", 1);
+                }
+                break;
+            case TokenKind_VariableReference:
+                if (tok.len == 0) {
+                    Parser_addPart(self, WordPart_Literal, "$", 1);
+                } else {
+                    Parser_addPart(self, WordPart_Variable, tok.s, tok.len);
+                }
+                break;
+            case TokenKind_LastExitCodeReq:
+                Parser_addPart(self, WordPart_LastExitCode, NULL, 0);
+                break;
+            case TokenKind_CommandSubstitution: {
+                if (need_more_input) {
+                    return Parser_needMoreInput(self, error);
+                }
+                ParseResult res = Parser_addSubstitution(self, &tok, error);
+                if (res != ParseResult_Success) {
+                    return res;
+                }
+                break;
+            }
+            case TokenKind_Pipe:
+                Parser_finishWord(self);
+                if (Parser_commandIsEmpty(self) || self->awaits_redirection_target) {
+                    return Parser_unexpected(self, &tok, error);
+                }
+                Parser_finishCommand(self);
+                self->pipe_line = Parser_lineAt(self, self->tok_start);
+                break;
+            case TokenKind_Background:
+                Parser_finishWord(self);
+                if (Parser_commandIsEmpty(self) || self->awaits_redirection_target) {
+                    return Parser_unexpected(self, &tok, error);
+                }
+                Parser_finishPipeline(self, self->tok_start);
+                Parser_backgroundList(self);
+                break;
+            case TokenKind_Semicolon:
+            case TokenKind_And:
+            case TokenKind_Or:
+                Parser_finishWord(self);
+                if (Parser_commandIsEmpty(self) || self->awaits_redirection_target) {
+                    return Parser_unexpected(self, &tok, error);
+                }
+                Parser_finishPipeline(self, self->tok_start);
+                if (tok.kind != TokenKind_Semicolon) {
+                    self->pipeline.condition = (tok.kind == TokenKind_And)
+                                                   ? PipelineCondition_IfSucceeded
+                                                   : PipelineCondition_IfFailed;
+                    self->pipe_line = Parser_lineAt(self, self->tok_start);
+                }
+                break;
+            case TokenKind_Redirect:
+                if (self->awaits_redirection_target && self->word.parts.size == 0) {
+                    return Parser_unexpected(self, &tok, error);
+                }
+                Parser_startRedirection(self, &tok);
+                break;
+            case TokenKind_Unexpected:
+                return Parser_unexpected(self, &tok, error);
+        }
+    }
+    if (self->awaits_redirection_target && self->word.parts.size == 0) {
+        return Parser_unexpectedNewline(self, error);
+    }
+    if (Parser_awaitsPipeStage(self) || Parser_awaitsListRest(self)) {
+        error->line = self->pipe_line;
+        return ParseResult_NeedMoreInput;
+    }
+    Parser_finishPipeline(self, self->tokenizer.len);
+
+    return ParseResult_Success;
+}
+
+/// Keeps the source of the unfinished pipeline, the next piece of input continues it
+static void Parser_carryInput(Parser* self) {
+    const size_t len = self->tokenizer.len;
+    Parser_lineAt(self, len);
+    if (self->pipeline_start == SIZE_MAX) {
+        return;
+    }
+    if (!self->pipeline_carried) {
+        ArenaString_init(&self->pipeline_text, self->arena);
+        self->pipeline_carried = true;
+    }
+    ArenaString_appendSlice(&self->pipeline_text, self->tokenizer.s + self->pipeline_start,
+                            len - self->pipeline_start);
+    self->pipeline_start = 0;
+}
+
+ParseResult Parser_feed(Parser* self, const char* src, size_t len, ParseError* error) {
+    assert(self);
+    Tokenizer_setInput(&self->tokenizer, src, len);
+    self->line_pos = 0;
+    const ParseResult res = Parser_parseInput(self, error);
+    if (res == ParseResult_NeedMoreInput) {
+        Parser_carryInput(self);
+    }
+    return res;
+}
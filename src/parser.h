@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "alloc.h"
+#include "array_list.h"
+
+typedef enum {
+    WordPart_Literal,
+    WordPart_Variable,
+    WordPart_LastExitCode,
+    WordPart_Home,
+    WordPart_Command,  // `$(...)` or `` `...` ``
+} WordPartKind;
+
+struct Program;
+
+typedef struct {
+    WordPartKind kind;
+    /// text of a literal or name of a variable
+    const char* s;
+    size_t len;
+    /// hash of the variable name, so that the lookup does not have to compute it
+    size_t hash;
+    /// parsed together with the rest for `WordPart_Command`
+    const struct Program* program;
+} WordPart;
+
+ARENA_ARRAY_LIST_STRUCT(WordPart, WordParts)
+
+typedef struct {
+    WordParts parts;
+} Word;
+
+ARENA_ARRAY_LIST_STRUCT(Word, Words)
+
+typedef struct {
+    const char* name;
+    size_t name_len;
+    Word value;
+} Assignment;
+
+ARENA_ARRAY_LIST_STRUCT(Assignment, Assignments)
+
+typedef enum {
+    Redirection_Input,   // `[n]<file`
+    Redirection_Output,  // `[n]>file`
+    Redirection_Append,  // `[n]>>file`
+    Redirection_Dup,     // `[n]>&m` or `[n]<&m`
+} RedirectionKind;
+
+typedef struct {
+    RedirectionKind kind;
+    int fd;
+    /// file name, or the descriptor to duplicate for `Redirection_Dup`
+    Word target;
+} Redirection;
+
+ARENA_ARRAY_LIST_STRUCT(Redirection, Redirections)
+
+typedef struct {
+    Assignments assignments;
+    Words words;
+    /// applied in order, after the pipeline's pipes
+    Redirections redirections;
+    size_t line;
+} Command;
+
+ARENA_ARRAY_LIST_STRUCT(Command, Commands)
+
+/// When a pipeline of a list runs, depending on the exit code of the last one that ran. A list
+/// is evaluated from left to right, `&&` and `||` bind equally tight
+typedef enum {
+    PipelineCondition_Always,       // first in the program or after `;`, `&` or a newline
+    PipelineCondition_IfSucceeded,  // after `&&`
+    PipelineCondition_IfFailed,     // after `||`
+} PipelineCondition;
+
+/// Commands connected with `|`, a single command is a pipeline of one stage
+typedef struct {
+    Commands commands;
+    PipelineCondition condition;
+    /// terminated with `&`, so the shell does not wait for it. Set on every pipeline of an
+    /// and/or list ended with `&`, the list runs as one job
+    bool background;
+    /// prefixed with the `time` keyword
+    bool timed;
+    /// source of the pipeline without the `&`, for `jobs`
+    const char* text;
+    size_t text_len;
+} Pipeline;
+
+ARENA_ARRAY_LIST_STRUCT(Pipeline, Pipelines)
+
+typedef struct Program {
+    Pipelines pipelines;
+} Program;
+
+typedef enum {
+    ParseResult_Success,
+    ParseResult_NeedMoreInput,
+    ParseResult_SyntaxError,
+} ParseResult;
+
+typedef struct {
+    /// line of the unexpected token or of the unterminated quote or pipe
+    size_t line;
+    const char* token;
+    size_t token_len;
+} ParseError;
+
+/// Parses the whole `src` up front. The program refers to memory of both `arena` and `src`,
+/// so they have to outlive it
+ParseResult Program_parse(Program* program, Arena* arena, const char* src, size_t len,
+                          ParseError* error);
+
+/// Parses a program given in pieces, like the lines typed in the REPL
+typedef struct Parser Parser;
+
+/// The parser and the program live in `arena`
+Parser* Parser_create(Arena* arena, Program* program);
+
+/// Parses the next piece of input, which has to outlive the program like in `Program_parse`.
+/// After `ParseResult_NeedMoreInput` the next piece continues where this one ended, a quote or
+/// pipeline left open included, so no input is scanned twice. Other results complete the program
+ParseResult Parser_feed(Parser* self, const char* src, size_t len, ParseError* error);
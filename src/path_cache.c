@@ -0,0 +1,324 @@
+#include "path_cache.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "common.h"
+#include "dyn_string.h"
+#include "trace.h"
+
+ARRAY_LIST_SIGNATURES(PathDir, PathDirs)
+ARRAY_LIST_IMPL(PathDir, PathDirs)
+ARRAY_LIST_SIGNATURES(char*, CommandNames)
+ARRAY_LIST_IMPL(char*, CommandNames)
+
+#define INITIAL_CAPACITY 64
+#define RECHECK_INTERVAL_SEC 1
+
+void PathCache_init(PathCache* self) {
+    assert(self);
+    *self = (PathCache){
+        .entries = NULL,
+        .cap = 0,
+        .size = 0,
+        .have_dirs = false,
+        .have_commands = false,
+    };
+    PathDirs_init(&self->dirs);
+    CommandNames_init(&self->commands);
+}
+
+static void PathCache_clearEntries(PathCache* self) {
+    for (size_t i = 0; i < self->cap; ++i) {
+        free(self->entries[i].name);
+        free(self->entries[i].path);
+        self->entries[i] = (PathCacheEntry){0};
+    }
+    self->size = 0;
+}
+
+static void PathDir_clearNames(PathDir* self) {
+    for (size_t i = 0; i < self->names.size; ++i) {
+        free(self->names.items[i]);
+    }
+    CommandNames_clear(&self->names);
+    self->listed = false;
+}
+
+static void PathCache_clearDirs(PathCache* self) {
+    for (size_t i = 0; i < self->dirs.size; ++i) {
+        free(self->dirs.items[i].dir);
+        PathDir_clearNames(&self->dirs.items[i]);
+        CommandNames_deinit(&self->dirs.items[i].names);
+    }
+    PathDirs_clear(&self->dirs);
+    self->have_dirs = false;
+    // the index refers to the names of the directories
+    CommandNames_clear(&self->commands);
+    self->have_commands = false;
+}
+
+void PathCache_deinit(PathCache* self) {
+    assert(self);
+    PathCache_clearEntries(self);
+    free(self->entries);
+    PathCache_clearDirs(self);
+    PathDirs_deinit(&self->dirs);
+    CommandNames_deinit(&self->commands);
+}
+
+void PathCache_clear(PathCache* self) {
+    assert(self);
+    PathCache_clearEntries(self);
+    PathCache_clearDirs(self);
+}
+
+static void statMtime(const char* dir, struct timespec* mtime) {
+    struct stat st;
+    if (stat(dir, &st) == -1) {
+        *mtime = (struct timespec){0};
+    } else {
+        *mtime = st.st_mtim;
+    }
+}
+
+static void PathCache_loadDirs(PathCache* self, const char* path_var) {
+    self->have_dirs = true;
+    clock_gettime(CLOCK_MONOTONIC, &self->last_check);
+    while (path_var) {
+        const char* colon = strchr(path_var, ':');
+        const size_t len = (colon) ? (size_t)(colon - path_var) : strlen(path_var);
+        if (len != 0) {
+            char* dir = mallocChecked(len + 1);
+            memcpy(dir, path_var, len);
+            dir[len] = '\0';
+
+            PathDir item = {.dir = dir, .listed = false};
+            CommandNames_init(&item.names);
+            statMtime(dir, &item.mtime);
+            PathDirs_append(&self->dirs, item);
+        }
+        path_var = (colon) ? colon + 1 : NULL;
+    }
+}
+
+/// Drops resolved entries if any of the directories has changed since it was read, the listings
+/// of the changed ones are read again when completion needs them
+static void PathCache_revalidate(PathCache* self) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec - self->last_check.tv_sec < RECHECK_INTERVAL_SEC) {
+        return;
+    }
+    self->last_check = now;
+
+    bool changed = false;
+    for (size_t i = 0; i < self->dirs.size; ++i) {
+        struct timespec mtime;
+        statMtime(self->dirs.items[i].dir, &mtime);
+        if (mtime.tv_sec != self->dirs.items[i].mtime.tv_sec ||
+            mtime.tv_nsec != self->dirs.items[i].mtime.tv_nsec) {
+            self->dirs.items[i].mtime = mtime;
+            PathDir_clearNames(&self->dirs.items[i]);
+            self->have_commands = false;
+            changed = true;
+        }
+    }
+    if (changed) {
+        PathCache_clearEntries(self);
+    }
+}
+
+static PathCacheEntry* PathCache_slot(const PathCache* self, const char* name) {
+    size_t i = hashBytes(name, strlen(name)) & (self->cap - 1);
+    while (self->entries[i].name != NULL && strcmp(self->entries[i].name, name) != 0) {
+        i = (i + 1) & (self->cap - 1);
+    }
+    return &self->entries[i];
+}
+
+static void PathCache_grow(PathCache* self) {
+    PathCacheEntry* old = self->entries;
+    const size_t old_cap = self->cap;
+
+    self->cap = (old_cap) ? old_cap * 2 : INITIAL_CAPACITY;
+    self->entries = callocChecked(self->cap, sizeof(PathCacheEntry));
+    for (size_t i = 0; i < old_cap; ++i) {
+        if (old[i].name != NULL) {
+            *PathCache_slot(self, old[i].name) = old[i];
+        }
+    }
+    free(old);
+}
+
+static char* resolve(const PathDirs* dirs, const char* name) {
+    const size_t name_len = strlen(name);
+    String buf;
+    String_init(&buf);
+    for (size_t i = 0; i < dirs->size; ++i) {
+        const char* dir = dirs->items[i].dir;
+        const size_t dir_len = strlen(dir);
+
+        String_clear(&buf);
+        String_appendSlice(&buf, dir, dir_len);
+        if (dir[dir_len - 1] != '/') {
+            String_append(&buf, '/');
+        }
+        String_appendSlice(&buf, name, name_len);
+        String_append(&buf, '\0');
+
+        // like `execvp`, directories and other files that can't be run don't end the search
+        struct stat st;
+        if (stat(buf.items, &st) == 0 && S_ISREG(st.st_mode) && access(buf.items, X_OK) == 0) {
+            return String_toOwnedSlice(&buf);
+        }
+    }
+    String_deinit(&buf);
+    return NULL;
+}
+
+char* PathCache_lookup(PathCache* self, const char* path_var, const char* name) {
+    assert(self);
+    assert(name);
+
+    if (!self->have_dirs) {
+        PathCache_loadDirs(self, path_var);
+    } else {
+        PathCache_revalidate(self);
+    }
+
+    if (self->cap != 0) {
+        PathCacheEntry* entry = PathCache_slot(self, name);
+        if (entry->name != NULL) {
+            entry->hits += 1;
+            return entry->path;
+        }
+    }
+
+    const TraceTime trace_start = Trace_begin();
+    char* path = resolve(&self->dirs, name);
+    Trace_end("path_search", name, trace_start);
+    if (!path) {
+        return NULL;
+    }
+
+    // keep the load factor under 1/2
+    if ((self->size + 1) * 2 > self->cap) {
+        PathCache_grow(self);
+    }
+    const size_t name_len = strlen(name);
+    PathCacheEntry* entry = PathCache_slot(self, name);
+    entry->name = mallocChecked(name_len + 1);
+    memcpy(entry->name, name, name_len + 1);
+    entry->path = path;
+    entry->hits = 1;
+    self->size += 1;
+    return path;
+}
+
+void PathCache_print(const PathCache* self, FILE* f) {
+    assert(self);
+    if (self->size == 0) {
+        fprintf(f, "hash: hash table empty\n");
+        return;
+    }
+
+    fprintf(f, "hits\tcommand\n");
+    for (size_t i = 0; i < self->cap; ++i) {
+        if (self->entries[i].name != NULL) {
+            fprintf(f, "%4zu\t%s\n", self->entries[i].hits, self->entries[i].path);
+        }
+    }
+}
+
+static void PathDir_list(PathDir* self) {
+    self->listed = true;
+    DIR* dir = opendir(self->dir);
+    if (!dir) {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat st;
+        if (entry->d_name[0] == '.' || fstatat(dirfd(dir), entry->d_name, &st, 0) == -1 ||
+            !S_ISREG(st.st_mode) || (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) == 0) {
+            continue;
+        }
+        const size_t len = strlen(entry->d_name);
+        char* name = mallocChecked(len + 1);
+        memcpy(name, entry->d_name, len + 1);
+        CommandNames_append(&self->names, name);
+    }
+    closedir(dir);
+}
+
+static int compareNames(const void* lhs, const void* rhs) {
+    return strcmp(*(char* const*)lhs, *(char* const*)rhs);
+}
+
+static void PathCache_buildCommands(PathCache* self) {
+    CommandNames_clear(&self->commands);
+    for (size_t i = 0; i < self->dirs.size; ++i) {
+        PathDir* dir = &self->dirs.items[i];
+        if (!dir->listed) {
+            PathDir_list(dir);
+        }
+        for (size_t j = 0; j < dir->names.size; ++j) {
+            CommandNames_append(&self->commands, dir->names.items[j]);
+        }
+    }
+
+    char** names = self->commands.items;
+    size_t size = self->commands.size;
+    if (size > 0) {
+        qsort(names, size, sizeof(char*), compareNames);
+        size_t unique = 1;
+        for (size_t i = 1; i < size; ++i) {
+            if (strcmp(names[i], names[unique - 1]) != 0) {
+                names[unique++] = names[i];
+            }
+        }
+        self->commands.size = unique;
+    }
+    self->have_commands = true;
+}
+
+size_t PathCache_complete(PathCache* self, const char* path_var, const char* prefix, size_t len,
+                          char* const** found) {
+    assert(self);
+    assert(found);
+
+    if (!self->have_dirs) {
+        PathCache_loadDirs(self, path_var);
+    } else {
+        PathCache_revalidate(self);
+    }
+    if (!self->have_commands) {
+        PathCache_buildCommands(self);
+    }
+
+    char* const* names = self->commands.items;
+    size_t lo = 0;
+    size_t hi = self->commands.size;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (strncmp(names[mid], prefix, len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t end = lo;
+    while (end < self->commands.size && strncmp(names[end], prefix, len) == 0) {
+        end += 1;
+    }
+    *found = names + lo;
+    return end - lo;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "array_list.h"
+
+ARRAY_LIST_STRUCT(char*, CommandNames)
+
+typedef struct {
+    char* dir;
+    struct timespec mtime;
+    /// executables in `dir`, listed when completion first needs them
+    CommandNames names;
+    bool listed;
+} PathDir;
+
+ARRAY_LIST_STRUCT(PathDir, PathDirs)
+
+typedef struct {
+    char* name;
+    char* path;
+    size_t hits;
+} PathCacheEntry;
+
+/// Maps command names to the executables `PATH` resolves them to. Directory modification times
+/// are rechecked at most once a second, a change in any of them drops all resolved entries
+typedef struct {
+    /// open addressing table, `cap` is a power of two and free slots have `name == NULL`
+    PathCacheEntry* entries;
+    size_t cap;
+    size_t size;
+    PathDirs dirs;
+    bool have_dirs;
+    struct timespec last_check;
+    /// names of all `dirs`, sorted and without duplicates, for completion. Only the directories
+    /// that changed are listed again when it is rebuilt
+    CommandNames commands;
+    bool have_commands;
+} PathCache;
+
+void PathCache_init(PathCache* self);
+void PathCache_deinit(PathCache* self);
+
+/// Forgets all resolved executables, directories are re-read from `PATH` on the next lookup
+void PathCache_clear(PathCache* self);
+
+/// Returns the full path of the executable `name` resolves to using `path_var`, or `NULL` if
+/// there is none. The result is owned by the cache and is valid until the next modification
+char* PathCache_lookup(PathCache* self, const char* path_var, const char* name);
+
+void PathCache_print(const PathCache* self, FILE* f);
+
+/// Finds the executables in `PATH` whose names start with `prefix`. Stores the first of them in
+/// `found`, they are sorted and valid until the next modification. Returns how many there are
+size_t PathCache_complete(PathCache* self, const char* path_var, const char* prefix, size_t len,
+                          char* const** found);
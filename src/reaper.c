@@ -0,0 +1,85 @@
+#include "reaper.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common.h"
+
+static int self_pipe[2] = {-1, -1};
+
+static void handle_sigchld(int sig) {
+    UNUSED(sig);
+    const int saved_errno = errno;
+    const char c = 0;
+    // if the pipe is full there is already a notification pending
+    ssize_t res = write(self_pipe[1], &c, 1);
+    UNUSED(res);
+    errno = saved_errno;
+}
+
+static bool setFlags(int fd) {
+    const int fl = fcntl(fd, F_GETFL);
+    return fl != -1 && fcntl(fd, F_SETFL, fl | O_NONBLOCK) != -1 &&
+           fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+bool Reaper_install(void) {
+    if (self_pipe[0] != -1) {
+        return true;
+    }
+
+    if (pipe(self_pipe) == -1) {
+        return false;
+    }
+    if (!setFlags(self_pipe[0]) || !setFlags(self_pipe[1])) {
+        close(self_pipe[0]);
+        close(self_pipe[1]);
+        self_pipe[0] = self_pipe[1] = -1;
+        return false;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(SIGCHLD, &sa, NULL) == 0;
+}
+
+bool Reaper_reinstall(void) {
+    if (self_pipe[0] != -1) {
+        close(self_pipe[0]);
+        close(self_pipe[1]);
+        self_pipe[0] = self_pipe[1] = -1;
+    }
+    return Reaper_install();
+}
+
+int Reaper_fd(void) {
+    return self_pipe[0];
+}
+
+void Reaper_drain(void) {
+    char buf[64];
+    while (read(self_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
+void Reaper_await(void) {
+    struct pollfd pfd = {.fd = self_pipe[0], .events = POLLIN};
+    while (poll(&pfd, 1, -1) == -1 && errno == EINTR) {
+    }
+    Reaper_drain();
+}
+
+int Reaper_exitCode(int status) {
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
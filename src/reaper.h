@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+/// Installs the `SIGCHLD` handler. Every time a child changes state a byte is written to a
+/// non-blocking self-pipe, so waiting for children can be multiplexed with other fds in `poll`
+bool Reaper_install(void);
+
+/// For a forked child that keeps running shell code. The inherited self-pipe is shared with the
+/// parent, so the child would consume notifications meant for it; this replaces it with a new one
+bool Reaper_reinstall(void);
+
+/// The read end of the self-pipe, becomes readable after a `SIGCHLD`
+int Reaper_fd(void);
+
+/// Consumes all pending notifications
+void Reaper_drain(void);
+
+/// Blocks until a child changes state. Notifications may be left over from children that were
+/// already waited for, so callers recheck what they are waiting for and call it again
+void Reaper_await(void);
+
+/// The exit code a shell reports for a `waitpid` status
+int Reaper_exitCode(int status);
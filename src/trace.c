@@ -0,0 +1,117 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc.h"
+
+/// Must be a power of two
+#define TRACE_CAPACITY 65536
+#define TRACE_DETAIL_LEN 32
+
+typedef struct {
+    const char* name;
+    char detail[TRACE_DETAIL_LEN];
+    TraceTime start;
+    TraceTime duration;
+} TraceEvent;
+
+bool trace_enabled = false;
+
+static struct {
+    char* path;
+    /// forked children have a copy of the buffer, only the shell itself writes it
+    pid_t pid;
+    TraceEvent* events;
+    /// all events recorded, the ones before the last `TRACE_CAPACITY` are overwritten
+    size_t count;
+} trace;
+
+TraceTime Trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TraceTime)ts.tv_sec * 1000000000ull + (TraceTime)ts.tv_nsec;
+}
+
+void Trace_record(const char* name, const char* detail, size_t detail_len, TraceTime start) {
+    TraceEvent* event = &trace.events[trace.count & (TRACE_CAPACITY - 1)];
+    trace.count += 1;
+    event->name = name;
+    event->start = start;
+    event->duration = Trace_now() - start;
+    if (detail_len > TRACE_DETAIL_LEN - 1) {
+        detail_len = TRACE_DETAIL_LEN - 1;
+    }
+    if (detail_len > 0) {
+        memcpy(event->detail, detail, detail_len);
+    }
+    event->detail[detail_len] = '\0';
+}
+
+static void writeEscaped(FILE* f, const char* s) {
+    for (; *s != '\0'; ++s) {
+        const unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+}
+
+static void Trace_write(void) {
+    if (getpid() != trace.pid) {
+        return;
+    }
+
+    FILE* f = fopen(trace.path, "w");
+    if (f == NULL) {
+        perror("Could not write the trace");
+    } else {
+        const size_t first = (trace.count > TRACE_CAPACITY) ? trace.count - TRACE_CAPACITY : 0;
+        fprintf(f, "{\"traceEvents\":[");
+        for (size_t i = first; i < trace.count; ++i) {
+            const TraceEvent* event = &trace.events[i & (TRACE_CAPACITY - 1)];
+            // timestamps are in microseconds
+            fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,",
+                    (i == first) ? "" : ",", event->name, (long)trace.pid, (long)trace.pid);
+            fprintf(f, "\"ts\":%.3f,\"dur\":%.3f", (double)event->start / 1000.0,
+                    (double)event->duration / 1000.0);
+            if (event->detail[0] != '\0') {
+                fprintf(f, ",\"args\":{\"detail\":\"");
+                writeEscaped(f, event->detail);
+                fprintf(f, "\"}");
+            }
+            fprintf(f, "}");
+        }
+        fprintf(f, "\n]}\n");
+        if (fclose(f) != 0) {
+            perror("Could not write the trace");
+        }
+    }
+
+    free(trace.path);
+    free(trace.events);
+    trace_enabled = false;
+}
+
+void Trace_init(void) {
+    const char* path = getenv("BLUSH_TRACE");
+    if (path == NULL || path[0] == '\0' || trace_enabled) {
+        return;
+    }
+
+    const size_t len = strlen(path);
+    trace.path = mallocChecked(len + 1);
+    memcpy(trace.path, path, len + 1);
+    trace.pid = getpid();
+    trace.events = mallocChecked(TRACE_CAPACITY * sizeof(TraceEvent));
+    trace.count = 0;
+    trace_enabled = true;
+    atexit(Trace_write);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/// Monotonic time in nanoseconds, `0` when tracing is off
+typedef unsigned long long TraceTime;
+
+extern bool trace_enabled;
+
+/// Turns tracing on if `BLUSH_TRACE` names a file. The spans are kept in a ring buffer, so only
+/// the most recent ones survive a long run, and are written to the file in the Chrome trace
+/// event format when the shell exits
+void Trace_init(void);
+
+TraceTime Trace_now(void);
+
+/// `name` has to outlive the trace, e.g. be a literal. `detail` is copied, only its start is
+/// kept if it is long
+void Trace_record(const char* name, const char* detail, size_t detail_len, TraceTime start);
+
+static inline TraceTime Trace_begin(void) {
+    return trace_enabled ? Trace_now() : 0;
+}
+
+/// Records a span started with `Trace_begin`, `detail` may be `NULL`
+static inline void Trace_end(const char* name, const char* detail, TraceTime start) {
+    if (trace_enabled) {
+        Trace_record(name, detail, (detail != NULL) ? strlen(detail) : 0, start);
+    }
+}
+
+static inline void Trace_endSlice(const char* name, const char* detail, size_t detail_len,
+                                  TraceTime start) {
+    if (trace_enabled) {
+        Trace_record(name, detail, detail_len, start);
+    }
+}
@@ -3,33 +3,16 @@
 #include <stdio.h>
 
 #include "alloc.h"
+#include "common.h"
 
-typedef Vars VarsImpl;
-ARRAY_LIST_SIGNATURES(char*, VarsImpl)
-ARRAY_LIST_IMPL(char*, VarsImpl)
+ARRAY_LIST_SIGNATURES(Var, VarList)
+ARRAY_LIST_IMPL(Var, VarList)
+ARRAY_LIST_SIGNATURES(char*, Envp)
+ARRAY_LIST_IMPL(char*, Envp)
 
-extern char** environ;
-
-void Vars_init(Vars* self) {
-    assert(self);
+#define INITIAL_INDEX_CAPACITY 64
 
-    VarsImpl_init(self);
-    for (char** env = environ; *env != NULL; ++env) {
-        const size_t len = strlen(*env);
-        char* item = mallocChecked(len + 1);
-        memcpy(item, *env, len + 1);
-        VarsImpl_append(self, item);
-    }
-    VarsImpl_append(self, NULL);
-}
-
-void Vars_deinit(Vars* self) {
-    assert(self);
-    for (size_t i = 0; i < self->size; ++i) {
-        free(self->items[i]);
-    }
-    VarsImpl_deinit(self);
-}
+extern char** environ;
 
 static bool keyeq(const char* lhs, const size_t lhs_len, const char* rhs, const size_t rhs_len) {
     assert(lhs);
@@ -43,44 +26,147 @@ static bool keyeq(const char* lhs, const size_t lhs_len, const char* rhs, const
     return memcmp(lhs, rhs, lhs_len) == 0;
 }
 
-const char* Vars_get(const Vars* self, const char* key, const size_t len) {
+/// Returns the index slot for `key`: either the one referring to it or the free one where it
+/// should be inserted
+static size_t* Vars_slotHashed(const Vars* self, const char* key, const size_t len,
+                               const size_t hash) {
+    size_t i = hash & (self->index_cap - 1);
+    for (;;) {
+        size_t* slot = &self->index[i];
+        if (*slot == 0) {
+            return slot;
+        }
+        const Var* var = &self->list.items[*slot - 1];
+        if (keyeq(var->s, var->key_len, key, len)) {
+            return slot;
+        }
+        i = (i + 1) & (self->index_cap - 1);
+    }
+}
+
+static size_t* Vars_slot(const Vars* self, const char* key, const size_t len) {
+    return Vars_slotHashed(self, key, len, hashBytes(key, len));
+}
+
+static void Vars_rehash(Vars* self, size_t new_cap) {
+    free(self->index);
+    self->index_cap = new_cap;
+    self->index = callocChecked(new_cap, sizeof(size_t));
+    for (size_t i = 0; i < self->list.size; ++i) {
+        const Var* var = &self->list.items[i];
+        *Vars_slot(self, var->s, var->key_len) = i + 1;
+    }
+}
+
+static Var* Vars_find(const Vars* self, const char* key, const size_t len) {
+    const size_t pos = *Vars_slot(self, key, len);
+    return (pos) ? &self->list.items[pos - 1] : NULL;
+}
+
+/// `s` must not be present yet
+static void Vars_insert(Vars* self, char* s, const size_t key_len, bool exported, bool owned) {
+    const Var var = {.s = s, .key_len = key_len, .exported = exported, .owned = owned};
+    // keep the load factor under 1/2
+    if ((self->list.size + 1) * 2 > self->index_cap) {
+        VarList_append(&self->list, var);
+        Vars_rehash(self, self->index_cap * 2);
+    } else {
+        size_t* slot = Vars_slot(self, s, key_len);
+        VarList_append(&self->list, var);
+        *slot = self->list.size;
+    }
+    self->envp_dirty |= exported;
+}
+
+void Vars_init(Vars* self) {
     assert(self);
-    assert(self->items[self->size - 1] == NULL);
 
-    for (size_t i = 0; i < self->size - 1; ++i) {
-        const char* eqpos = strchr(self->items[i], '=');
-        const size_t lhs_len = (size_t)(eqpos - self->items[i]);
+    VarList_init(&self->list);
+    Envp_init(&self->envp);
+    self->index = NULL;
+    self->index_cap = 0;
+    self->envp_is_environ = true;
 
-        if (keyeq(self->items[i], lhs_len, key, len)) {
-            return eqpos + 1;
+    size_t cap = INITIAL_INDEX_CAPACITY;
+    size_t count = 0;
+    for (char** env = environ; *env != NULL; ++env) {
+        count += 1;
+    }
+    while (cap < count * 2) {
+        cap *= 2;
+    }
+    VarList_ensureCapacity(&self->list, count);
+    Vars_rehash(self, cap);
+
+    bool skipped = false;
+    for (char** env = environ; *env != NULL; ++env) {
+        const char* eqpos = strchr(*env, '=');
+        const size_t key_len = (eqpos) ? (size_t)(eqpos - *env) : 0;
+        if (!eqpos || Vars_find(self, *env, key_len)) {
+            skipped = true;
+            continue;
         }
+        Vars_insert(self, *env, key_len, true, false);
     }
+    // children must not get what the shell ignores
+    self->envp_dirty = skipped;
+}
 
-    return NULL;
+/// Frees `var`'s string if it is not the one from `environ`
+static void Var_release(Var* var) {
+    if (var->owned) {
+        free(var->s);
+    }
 }
 
-static void replaceValue(char** item, size_t key_len, const char* new_val, size_t val_len) {
-    const size_t new_len = key_len + 1 + val_len;
+void Vars_deinit(Vars* self) {
+    assert(self);
+    for (size_t i = 0; i < self->list.size; ++i) {
+        Var_release(&self->list.items[i]);
+    }
+    VarList_deinit(&self->list);
+    Envp_deinit(&self->envp);
+    free(self->index);
+}
 
-    *item = reallocChecked(*item, new_len + 1);
-    memcpy(*item + key_len + 1, new_val, val_len);
-    (*item)[new_len] = '\0';
+const char* Vars_get(const Vars* self, const char* key, const size_t len) {
+    return Vars_getHashed(self, key, len, hashBytes(key, len));
+}
+
+const char* Vars_getHashed(const Vars* self, const char* key, const size_t len,
+                           const size_t hash) {
+    assert(self);
+
+    const size_t pos = *Vars_slotHashed(self, key, len, hash);
+    return (pos) ? self->list.items[pos - 1].s + self->list.items[pos - 1].key_len + 1 : NULL;
+}
+
+static void replaceValue(Var* var, const char* new_val, size_t val_len) {
+    const size_t new_len = var->key_len + 1 + val_len;
+
+    if (var->owned) {
+        var->s = reallocChecked(var->s, new_len + 1);
+    } else {
+        char* s = mallocChecked(new_len + 1);
+        memcpy(s, var->s, var->key_len + 1);
+        var->s = s;
+        var->owned = true;
+    }
+    memcpy(var->s + var->key_len + 1, new_val, val_len);
+    var->s[new_len] = '\0';
 }
 
 void Vars_set(Vars* self, const char* key, size_t key_len, const char* value, size_t value_len,
               bool replace) {
     assert(self);
-    assert(self->items[self->size - 1] == NULL);
-
-    for (size_t i = 0; i < self->size - 1; ++i) {
-        const char* eqpos = strchr(self->items[i], '=');
-        const size_t cur_key_len = (size_t)(eqpos - self->items[i]);
-        if (keyeq(self->items[i], cur_key_len, key, key_len)) {
-            if (replace) {
-                replaceValue(&self->items[i], cur_key_len, value, value_len);
-            }
-            return;
+
+    Var* var = Vars_find(self, key, key_len);
+    if (var) {
+        if (replace) {
+            replaceValue(var, value, value_len);
+            self->envp_dirty |= var->exported;
         }
+        return;
     }
 
     // value was not replaced, have to add one
@@ -91,52 +177,110 @@ void Vars_set(Vars* self, const char* key, size_t key_len, const char* value, si
     memcpy(item + key_len + 1, value, value_len);
     item[len] = '\0';
 
-    VarsImpl_insert(self, item, self->size - 2);
+    Vars_insert(self, item, key_len, false, true);
 }
 
 bool Vars_setRawMove(Vars* self, char* s, bool replace) {
     assert(self);
-    assert(self->items[self->size - 1] == NULL);
-
-    const size_t rhs_len = (size_t)(strchr(s, '=') - s);
-    for (size_t i = 0; i < self->size - 1; ++i) {
-        const char* eqpos = strchr(self->items[i], '=');
-        const size_t lhs_len = (size_t)(eqpos - self->items[i]);
-        if (keyeq(self->items[i], lhs_len, s, rhs_len)) {
-            if (replace) {
-                free(self->items[i]);
-                self->items[i] = s;
-            }
-            return replace;
+
+    const size_t key_len = (size_t)(strchr(s, '=') - s);
+    Var* var = Vars_find(self, s, key_len);
+    if (var) {
+        if (replace) {
+            Var_release(var);
+            var->s = s;
+            var->owned = true;
+            self->envp_dirty |= var->exported;
         }
+        return replace;
     }
 
     // value was not replaced, have to add one
-    VarsImpl_insert(self, s, self->size - 2);
+    Vars_insert(self, s, key_len, false, true);
     return true;
 }
 
 void Vars_setRawCopy(Vars* self, const char* s, bool replace) {
     assert(self);
-    assert(self->items[self->size - 1] == NULL);
-
-    const size_t s_key_len = (size_t)(strchr(s, '=') - s);
-    for (size_t i = 0; i < self->size - 1; ++i) {
-        const char* eqpos = strchr(self->items[i], '=');
-        const size_t lhs_key_len = (size_t)(eqpos - self->items[i]);
-        if (keyeq(self->items[i], lhs_key_len, s, s_key_len)) {
-            if (replace) {
-                size_t len = strlen(s);
-                self->items[i] = reallocChecked(self->items[i], len + 1);
-                memcpy(self->items[i], s, len + 1);
-            }
-            return;
+
+    const size_t key_len = (size_t)(strchr(s, '=') - s);
+    Var* var = Vars_find(self, s, key_len);
+    if (var) {
+        if (replace) {
+            replaceValue(var, s + key_len + 1, strlen(s + key_len + 1));
+            self->envp_dirty |= var->exported;
         }
+        return;
     }
 
     // value was not replaced, have to add one
     size_t len = strlen(s);
     char* item = mallocChecked(len + 1);
     memcpy(item, s, len + 1);
-    VarsImpl_insert(self, item, self->size - 2);
+    Vars_insert(self, item, key_len, false, true);
+}
+
+bool Vars_unset(Vars* self, const char* key, size_t len) {
+    assert(self);
+
+    const size_t pos = *Vars_slot(self, key, len);
+    if (pos == 0) {
+        return false;
+    }
+    Var* var = &self->list.items[pos - 1];
+    self->envp_dirty |= var->exported;
+    Var_release(var);
+    *var = VarList_pop(&self->list);
+    // unsetting is rare, so the index is simply rebuilt instead of deleting from the probe chain
+    Vars_rehash(self, self->index_cap);
+    return true;
+}
+
+bool Vars_export(Vars* self, const char* key, size_t len) {
+    assert(self);
+
+    Var* var = Vars_find(self, key, len);
+    if (!var) {
+        return false;
+    }
+    self->envp_dirty |= !var->exported;
+    var->exported = true;
+    return true;
+}
+
+void Vars_printExported(const Vars* self, FILE* f) {
+    for (size_t i = 0; i < self->list.size; ++i) {
+        const Var* var = &self->list.items[i];
+        if (!var->exported) {
+            continue;
+        }
+        // single quotes keep everything literal, a quote itself ends them for an escaped one
+        fprintf(f, "export %.*s='", (int)var->key_len, var->s);
+        for (const char* c = var->s + var->key_len + 1; *c; ++c) {
+            if (*c == '\'') {
+                fputs("'\\''", f);
+            } else {
+                fputc(*c, f);
+            }
+        }
+        fputs("'\n", f);
+    }
+}
+
+char* const* Vars_envp(Vars* self) {
+    assert(self);
+
+    if (self->envp_dirty) {
+        Envp_clear(&self->envp);
+        Envp_ensureCapacity(&self->envp, self->list.size + 1);
+        for (size_t i = 0; i < self->list.size; ++i) {
+            if (self->list.items[i].exported) {
+                Envp_append(&self->envp, self->list.items[i].s);
+            }
+        }
+        Envp_append(&self->envp, NULL);
+        self->envp_dirty = false;
+        self->envp_is_environ = false;
+    }
+    return (self->envp_is_environ) ? environ : self->envp.items;
 }
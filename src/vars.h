@@ -1,17 +1,57 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "array_list.h"
-ARRAY_LIST_STRUCT(char*, Vars)
 
+typedef struct {
+    char* s;  // `KEY=VALUE`
+    size_t key_len;
+    /// whether it is passed to children in `envp`
+    bool exported;
+    /// `false` while `s` is still the string from `environ`, which is copied on the first write
+    bool owned;
+} Var;
+
+ARRAY_LIST_STRUCT(Var, VarList)
+ARRAY_LIST_STRUCT(char*, Envp)
+
+typedef struct {
+    VarList list;
+    /// open addressing index over `list`, slots hold `position + 1` and `0` marks a free slot
+    size_t* index;
+    size_t index_cap;
+    /// `NULL`-terminated `KEY=VALUE` array for `execve`, rebuilt only after modifications
+    Envp envp;
+    bool envp_dirty;
+    /// until the exported variables change, children get `environ` itself
+    bool envp_is_environ;
+} Vars;
+
+/// Refers to the strings of `environ` without copying them, nothing but the list and the index
+/// is allocated
 void Vars_init(Vars* self);
 void Vars_deinit(Vars* self);
 const char* Vars_get(const Vars* self, const char* key, size_t len);
+/// Same as `Vars_get`, but with `hash` of the key computed upfront via `hashBytes`
+const char* Vars_getHashed(const Vars* self, const char* key, size_t len, size_t hash);
 void Vars_set(Vars* self, const char* key, size_t key_len, const char* value, size_t value_len,
               bool replace);
 
-/// Returns `true` if `s` was inserted
+/// Returns `false` if `key` was not set
+bool Vars_unset(Vars* self, const char* key, size_t len);
+
+/// Passes `key` to children from now on. Returns `false` if it is not set
+bool Vars_export(Vars* self, const char* key, size_t len);
+
+/// Prints the exported variables in the form `export` accepts them
+void Vars_printExported(const Vars* self, FILE* f);
+
+/// Variables set by the shell are not exported until `Vars_export`, only the ones inherited from
+/// the environment are. Returns `true` if `s` was inserted
 bool Vars_setRawMove(Vars* self, char* s, bool replace);
 
 void Vars_setRawCopy(Vars* self, const char* s, bool replace);
+
+char* const* Vars_envp(Vars* self);
@@ -0,0 +1,107 @@
+#!/bin/sh
+# Usage: tests/run.sh BLUSH_PATH
+# Runs blush scripts whose misbehavior is a hang or a leak rather than wrong output, each with a
+# time limit
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 BLUSH_PATH" >&2
+    exit 2
+fi
+blush=$1
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+# run_script NAME EXPECTED [SECONDS]: runs $tmp/NAME.sh and compares its output with EXPECTED,
+# it fails if it takes longer than SECONDS, 10 by default
+run_script() {
+    out=$(timeout "${3:-10}" "$blush" "$tmp/$1.sh" 2>&1)
+    code=$?
+    if [ $code -eq 124 ]; then
+        echo "FAIL $1: timed out"
+        failed=1
+    elif [ "$out" != "$2" ]; then
+        printf 'FAIL %s: expected\n%s\ngot\n%s\n' "$1" "$2" "$out"
+        failed=1
+    else
+        echo "ok   $1"
+    fi
+}
+
+# the subshell of a substitution has its own SIGCHLD notifications, so the shell waiting for it
+# doesn't take the ones its `wait` needs
+cat > "$tmp/wait_in_substitution.sh" << 'EOF'
+x=$(/bin/true & wait -n; /bin/true & wait -n; /bin/true & wait; echo waited)
+echo $x
+EOF
+run_script wait_in_substitution waited
+
+# `&` sends the whole and/or list to the background, not just its last pipeline
+cat > "$tmp/background_list.sh" << 'EOF'
+sleep 1 && true & echo now
+EOF
+run_script background_list now 0.5
+
+# a command that can't be spawned sets the exit code instead of leaving the previous one
+ln -s "$tmp/loop" "$tmp/loop"
+cat > "$tmp/spawn_error_status.sh" << EOF
+true; $tmp/loop; echo \$?
+false; $tmp/loop || echo failed
+EOF
+error="Failed to execute command: Too many levels of symbolic links"
+run_script spawn_error_status \
+    "$(printf '%s: line 1: %s\n126\n%s: line 2: %s\nfailed' "$tmp/spawn_error_status.sh" \
+        "$error" "$tmp/spawn_error_status.sh" "$error")"
+
+# integer comparisons of `test`, `-ne` once took the path of the file operators `-nt` and `-ot`
+cat > "$tmp/test_integers.sh" << 'EOF'
+test 1 -ne 2; echo $?
+test 1 -ne 1; echo $?
+test 1 -eq 1; echo $?
+test 1 -eq 2; echo $?
+test 1 -lt 2; echo $?
+test 2 -lt 1; echo $?
+test 2 -le 2; echo $?
+test 3 -le 2; echo $?
+test 2 -gt 1; echo $?
+test 1 -gt 2; echo $?
+test 2 -ge 2; echo $?
+test 1 -ge 2; echo $?
+[ -5 -ne 5 ]; echo $?
+EOF
+run_script test_integers "$(printf '0\n1\n0\n1\n0\n1\n0\n1\n0\n1\n0\n1\n0')"
+
+# a script that starts jobs without collecting them must not keep every finished one, so its
+# memory stays flat. Resident sizes are only comparable in builds without ASan, whose allocator
+# keeps freed memory in quarantine
+jobs_script() {
+    i=0
+    while [ $i -lt "$1" ]; do
+        echo '/bin/true &'
+        i=$((i + 1))
+    done
+}
+rss="sh -c 'grep VmRSS /proc/\$PPID/status'"
+{
+    jobs_script 2000
+    echo "$rss"
+    jobs_script 3000
+    echo "$rss"
+    echo 'jobs | wc -l'
+} > "$tmp/many_jobs.sh"
+out=$(timeout 60 "$blush" "$tmp/many_jobs.sh" 2>&1)
+set -- $(echo "$out" | awk '/^VmRSS:/ {print $2} /^ *[0-9]+ *$/ {print $1}')
+if [ $# -ne 3 ]; then
+    printf 'FAIL many_jobs: unexpected output\n%s\n' "$out"
+    failed=1
+elif [ "$3" -gt 1100 ]; then
+    echo "FAIL many_jobs: $3 jobs kept"
+    failed=1
+elif [ $(($2 - $1)) -gt 128 ]; then
+    echo "FAIL many_jobs: grew from $1 kB to $2 kB"
+    failed=1
+else
+    echo "ok   many_jobs"
+fi
+
+exit $failed